@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "yolo-nas.hpp"
+
+using json = nlohmann::json;
+
+// Fast non cryptographic 64 bit hash
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 0);
+
+uint64_t hashFile(std::string path);
+
+// Hash of everything that changes detections for the same image: model weights and processing config
+uint64_t hashConfig(std::string modelPath, json config);
+
+// Persistent content addressed detection cache.
+// The file is an append only log of records (content hash, config hash, detections), memory mapped and
+// indexed on open. Only records matching the current config hash are visible.
+class DetectionCache
+{
+private:
+    struct Entry
+    {
+        size_t offset;
+        uint32_t count;
+    };
+
+    std::string path;
+    uint64_t config;
+    const uchar *mapped = nullptr;
+    size_t mappedSize = 0;
+    std::vector<char> fallback; // file content when mmap isn't available
+    std::unordered_map<uint64_t, Entry> index;
+    std::unordered_map<uint64_t, std::vector<Detection>> appended;
+    FILE *out = nullptr;
+    std::mutex lock;
+
+    size_t load();
+
+public:
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+
+    DetectionCache(std::string file, uint64_t configHash);
+    ~DetectionCache();
+
+    bool lookup(uint64_t content, std::vector<Detection> &detections);
+    void insert(uint64_t content, const std::vector<Detection> &detections);
+    size_t size();
+    std::string stats();
+};
@@ -1,20 +1,30 @@
 #pragma once
 
+#include <map>
 #include <vector>
+#include <argparse/argparse.hpp>
 #include <nlohmann/json.hpp>
 
+#include "processing.hpp"
+#include "threading.hpp"
+
 using json = nlohmann::json;
 
 enum SourceType
 {
     IMAGE,
-    VIDEO
+    VIDEO,
+    DIRECTORY,
+    STREAM
 };
 
 struct Source
 {
     SourceType type;
     std::string path;
+    int width = 0; // raw stream frame size and pixel format
+    int height = 0;
+    PixelFormat format = FMT_BGR;
 };
 
 struct Net
@@ -30,6 +40,16 @@ struct Processing
     json PrepSteps;
     float scoreThresh = -1.0f;
     float iouThresh = -1.0f;
+    bool swapRB = true; // false when the model takes BGR input (channel swap folded into the model)
+    std::vector<std::string> classes;          // label names or indices, empty = all classes
+    std::map<std::string, float> classThresh; // per class score threshold
+};
+
+struct Monitoring
+{
+    int port = 0;
+    std::string jsonPath;
+    double interval = 5.0;
 };
 
 struct Config
@@ -38,6 +58,20 @@ struct Config
     Source source;
     Processing processing;
     std::string exportPath;
+    Threading threading;
+    Monitoring monitoring;
+    std::string cachePath;
+    std::string outputFormat; // jsonl | binary, detections written to stdout on stream source
 };
 
+void addThreadingArgs(argparse::ArgumentParser &program);
+
+Threading parseThreadingArgs(argparse::ArgumentParser &program);
+
+void addClassArgs(argparse::ArgumentParser &program);
+
+void parseClassArgs(argparse::ArgumentParser &program, Processing &processing);
+
+void parseMetadata(std::string path, Net &net, Processing &processing);
+
 Config parseCLI(int argc, char **argv);
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "yolo-nas.hpp"
+
+using json = nlohmann::json;
+
+struct Annotation
+{
+    int classID; // model class index, -1 if the category isn't in labels
+    float bbox[4];
+    bool crowd;
+};
+
+struct CocoImage
+{
+    int id;
+    std::string path;
+};
+
+class CocoDataset
+{
+public:
+    std::vector<CocoImage> images;
+    std::map<int, std::vector<Annotation>> annotations; // by image id
+
+    CocoDataset(std::string imageDir, std::string annotationPath, std::vector<std::string> &labels);
+};
+
+// COCO style bbox evaluation (IoU 0.5:0.05:0.95, 101 point interpolated AP, 100 detections per class per image)
+class CocoEvaluator
+{
+private:
+    struct Match
+    {
+        float score;
+        uint16_t tp;
+        uint16_t ignored;
+    };
+
+    CocoDataset &dataset;
+    int numClasses;
+    std::vector<std::vector<Match>> matches; // per class
+    std::vector<int> numGT;                  // non crowd ground truth per class
+    std::mutex lock;
+
+    double averagePrecision(std::vector<Match> &classMatches, int nGT, int iouIdx);
+
+public:
+    static constexpr int NUM_IOU = 10;
+    static constexpr int MAX_DETS = 100;
+
+    CocoEvaluator(CocoDataset &data, int classes);
+
+    void add(int imageID, std::vector<Detection> &detections);
+    json summarize(std::vector<int> classes = {}); // averages over the given classes only, default all
+};
+
+class LatencyStats
+{
+private:
+    std::vector<double> samples;
+    std::mutex lock;
+
+public:
+    void add(double ms);
+    size_t count();
+    double percentile(double p);
+    json summarize();
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+enum Stage
+{
+    STAGE_PREPROCESS,
+    STAGE_FORWARD,
+    STAGE_POSTPROCESS,
+    STAGE_NMS,
+    STAGE_DRAW,
+    STAGE_ENCODE,
+    STAGE_COUNT
+};
+
+const std::vector<std::string> STAGE_NAMES{"preprocess", "forward", "postprocess", "nms", "draw", "encode"};
+
+// Fixed bucket latency histogram, updated with relaxed atomics only
+class Histogram
+{
+public:
+    static constexpr int NUM_BUCKETS = 15;
+    static constexpr double BOUNDS[NUM_BUCKETS] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+                                                   0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0}; // seconds
+
+    std::atomic<uint64_t> buckets[NUM_BUCKETS + 1] = {}; // last one is +Inf
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sumNanos{0};
+
+    void observe(std::chrono::nanoseconds elapsed);
+};
+
+class Metrics
+{
+private:
+    std::mutex registry;
+    std::vector<std::string> labels;
+    std::unique_ptr<std::atomic<uint64_t>[]> detections;
+    std::map<std::string, std::atomic<int64_t>> queues;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    std::atomic<int64_t> windowStart{0};
+    std::atomic<uint64_t> windowFrames{0};
+    std::atomic<int64_t> lastFrame{-1000000000};
+    std::atomic<double> fps{0.0};
+
+    double currentFps();
+
+public:
+    Histogram stages[STAGE_COUNT];
+    std::atomic<uint64_t> framesProcessed{0};
+    std::atomic<uint64_t> framesDropped{0};
+
+    void setLabels(const std::vector<std::string> &classLabels);
+    void countDetection(int classID);
+    void frameProcessed();
+    void frameDropped();
+    std::atomic<int64_t> &queue(std::string name);
+
+    std::string prometheus();
+    json toJson();
+};
+
+Metrics &metrics();
+
+class StageTimer
+{
+private:
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    StageTimer(Stage s);
+    ~StageTimer();
+};
+
+// Serves Prometheus text format on http://127.0.0.1:<port>/metrics (and json on /metrics.json)
+class MetricsServer
+{
+private:
+    int fd = -1;
+    std::atomic<bool> running{false};
+    std::thread worker;
+    void serve();
+
+public:
+    MetricsServer(int port);
+    ~MetricsServer();
+};
+
+// Periodically dumps metrics as json to a file
+class MetricsDumper
+{
+private:
+    std::string path;
+    std::chrono::milliseconds interval;
+    bool running = true;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::thread worker;
+    void dump();
+
+public:
+    MetricsDumper(std::string file, double seconds);
+    ~MetricsDumper();
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+class WorkerPool
+{
+private:
+    std::atomic<size_t> cursor{0};
+    size_t total = 0;
+    std::atomic<int64_t> *depth; // metrics gauge of pending items
+
+public:
+    int workers;
+    std::vector<std::vector<int>> cpus; // worker i is pinned to cpus[i % cpus.size()]
+
+    WorkerPool(int n, std::vector<std::vector<int>> cpuSets = {});
+
+    // Runs `worker(id)` on every thread and blocks until all of them return.
+    // Workers pull item indices with `next` until the range is exhausted.
+    void run(size_t count, std::function<void(int)> worker);
+    bool next(size_t &item);
+    size_t pending();
+};
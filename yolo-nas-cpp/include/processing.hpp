@@ -7,6 +7,28 @@
 
 using json = nlohmann::json;
 
+enum PixelFormat
+{
+    FMT_BGR,
+    FMT_RGB,
+    FMT_NV12,
+    FMT_I420
+};
+
+// Non-owning view over an external frame. Strides are in bytes, planes follow the pixel format
+// (packed BGR/RGB: 1 plane, NV12: Y + interleaved UV, I420: Y + U + V).
+struct ImageBuffer
+{
+    PixelFormat format = FMT_BGR;
+    int width = 0;
+    int height = 0;
+    const uchar *planes[3] = {nullptr, nullptr, nullptr};
+    size_t strides[3] = {0, 0, 0};
+
+    ImageBuffer();
+    ImageBuffer(const uchar *data, int w, int h, PixelFormat fmt, size_t stride = 0);
+};
+
 class PreProcessing
 {
 private:
@@ -23,12 +45,16 @@ public:
                    {{"CenterPad", {{"pad_value", 114}}}},
                    {{"Standardize", {{"max_value", 255.0}}}}};
     cv::Size outShape{640, 640};
+    int threads = 0;
+    bool swapRB = true;
+    int blobDepth = CV_32F;
 
     PreProcessing();
-    PreProcessing(json &steps, std::vector<int> shape);
+    PreProcessing(json &steps, std::vector<int> shape, bool swap = true);
 
     static void rescaleImage(cv::Mat &img, cv::Mat &dst, cv::Size size);
     json run(cv::Mat &img, cv::Mat &dst);
+    json run(ImageBuffer &img, cv::Mat &dst);
 };
 
 class PostProcessing
@@ -44,10 +70,14 @@ public:
                    {{"Standardize", {{"max_value", 255.0}}}}};
     float iouThresh = 0.45f;
     float scoreThresh = 0.25f;
+    std::vector<int> classes;       // sorted active class ids, empty = every class with scoreThresh
+    std::vector<float> classThresh; // score threshold of each active class
 
     PostProcessing();
     PostProcessing(json &steps, float score, float iou);
 
+    void setClassFilter(std::vector<int> ids, std::vector<float> thresholds);
+
     void run(std::vector<std::vector<cv::Mat>> &outputs,
              std::vector<cv::Rect> &boxes,
              std::vector<int> &labels,
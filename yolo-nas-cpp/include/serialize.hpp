@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "yolo-nas.hpp"
+
+using json = nlohmann::json;
+
+// Fixed size (24 bytes) native endian record, shared by the detection cache and binary outputs
+struct DetectionRecord
+{
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+    int32_t classID;
+    float score;
+};
+
+// Binary stream output: one header per frame followed by `count` DetectionRecord
+struct FrameHeader
+{
+    uint64_t frame;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+DetectionRecord toRecord(const Detection &det);
+
+Detection fromRecord(const DetectionRecord &record);
+
+json detectionsToJson(const std::vector<Detection> &detections, const std::vector<std::string> &labels);
+
+void writeBinaryFrame(std::ostream &out, uint64_t frame, const std::vector<Detection> &detections);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "processing.hpp"
+
+// Bytes of one tightly packed frame (no row padding)
+size_t frameBytes(PixelFormat format, int width, int height);
+
+// Reads fixed size raw frames from stdin ("-"), a named pipe or a file into a ring of reusable buffers.
+// A reader thread fills the next slot while the current frame is processed, no allocation happens per frame.
+class RawFrameReader
+{
+private:
+    std::FILE *file;
+    bool ownsFile;
+    size_t frameSize;
+    std::vector<std::vector<uchar>> slots;
+    size_t head = 0; // next slot handed to the consumer
+    size_t filled = 0;
+    bool finished = false;
+    bool stopped = false;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread reader;
+    std::atomic<int64_t> *depth;
+
+    void readLoop();
+
+public:
+    RawFrameReader(std::string path, size_t bytes, int numSlots = 2);
+    ~RawFrameReader();
+
+    const uchar *next(); // blocks until a frame is ready, nullptr at end of stream
+    void release();      // hands the frame returned by next() back to the reader
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct Threading
+{
+    int inference = 0;  // OpenCV parallel pool size used by net.forward, 0 keeps OpenCV default
+    int preprocess = 0; // parallel stripes of the fused buffer preprocessing, 0 uses the whole pool
+    int io = 0;         // decoder threads of cv::VideoCapture, 0 keeps backend default
+    std::vector<std::vector<int>> cpus; // replica i is pinned to cpus[i % cpus.size()]
+};
+
+std::vector<int> parseCPUList(std::string list);
+
+std::vector<int> numaNodeCPUs(int node);
+
+bool pinThread(const std::vector<int> &cpus);
+
+void applyThreading(Threading &threading, int replicas = 1);
+
+std::string describeCPUs(const std::vector<int> &cpus);
@@ -13,6 +13,10 @@ void exists(std::string path);
 
 bool isNumber(const std::string &s);
 
+std::vector<std::string> listImages(std::string dir);
+
+std::vector<uchar> readBytes(std::string path);
+
 const std::vector<std::string> COCO_LABELS{"person", "bicycle", "car", "motorcycle", "airplane", "bus", "train", "truck", "boat",
                                            "traffic light", "fire hydrant", "stop sign", "parking meter", "bench", "bird", "cat",
                                            "dog", "horse", "sheep", "cow", "elephant", "bear", "zebra", "giraffe", "backpack",
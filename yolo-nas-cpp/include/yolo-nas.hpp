@@ -1,5 +1,6 @@
 #pragma once
 
+#include <map>
 #include <vector>
 #include <opencv2/opencv.hpp>
 #include <opencv2/dnn.hpp>
@@ -7,11 +8,20 @@
 #include "processing.hpp"
 #include "draw.hpp"
 
+struct Detection
+{
+    cv::Rect box;
+    int classID;
+    float score;
+};
+
 class YoloNAS
 {
 private:
     int netInputShape[4] = {1, 3, 0, 0};
+    cv::Mat inputBlob; // reused across frames, first touched by the thread building the net
     void warmup(int round);
+    std::vector<Detection> infer(cv::Mat &blob, json &metadata);
     Colors colors;
 
 public:
@@ -22,6 +32,11 @@ public:
 
     PreProcessing preprocess;
     PostProcessing postprocess;
-    YoloNAS(std::string netPath, bool cuda, json &prepSteps, std::vector<int> imgsz, float score, float iou, std::vector<std::string> &labels);
+    YoloNAS(std::string netPath, bool cuda, json &prepSteps, std::vector<int> imgsz, float score, float iou, std::vector<std::string> &labels, bool swapRB = true);
+    void filterClasses(std::vector<std::string> &classes, std::map<std::string, float> &thresholds);
+    std::vector<Detection> detect(cv::Mat &img);
+    std::vector<Detection> detect(ImageBuffer &img);
+    void draw(cv::Mat &img, std::vector<Detection> &detections);
     void predict(cv::Mat &img);
+    json describe();
 };
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <iomanip>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cache.hpp"
+#include "serialize.hpp"
+#include "utils.hpp"
+
+static const char CACHE_MAGIC[8] = {'Y', 'N', 'A', 'S', 'D', 'C', '0', '1'};
+
+struct RecordHeader
+{
+    uint64_t content;
+    uint64_t config;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed)
+{
+    // xxhash64 like: 4 independent lanes over 32 byte stripes, then tail and avalanche
+    const uint64_t p1 = 0x9E3779B185EBCA87ULL, p2 = 0xC2B2AE3D27D4EB4FULL, p3 = 0x165667B19E3779F9ULL;
+    const uchar *p = (const uchar *)data;
+    size_t len = size;
+    uint64_t v;
+
+    uint64_t h = seed + p3;
+    if (len >= 32)
+    {
+        uint64_t acc[4] = {seed + p1 + p2, seed + p2, seed, seed - p1};
+        while (len >= 32)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                std::memcpy(&v, p + i * 8, 8);
+                acc[i] = rotl(acc[i] + v * p2, 31) * p1;
+            }
+            p += 32;
+            len -= 32;
+        }
+
+        h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+        for (int i = 0; i < 4; i++)
+            h = (h ^ (rotl(acc[i] * p2, 31) * p1)) * p1 + p3;
+    }
+
+    h += (uint64_t)size;
+    while (len >= 8)
+    {
+        std::memcpy(&v, p, 8);
+        h ^= rotl(v * p2, 31) * p1;
+        h = rotl(h, 27) * p1 + p3;
+        p += 8;
+        len -= 8;
+    }
+    while (len > 0)
+    {
+        h ^= (uint64_t)(*p) * p3;
+        h = rotl(h, 11) * p1;
+        p++;
+        len--;
+    }
+
+    h ^= h >> 33;
+    h *= p2;
+    h ^= h >> 29;
+    h *= p3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t hashFile(std::string path)
+{
+    std::ifstream f(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    return hashBytes(bytes.data(), bytes.size());
+}
+
+uint64_t hashConfig(std::string modelPath, json config)
+{
+    std::string description = config.dump();
+    return hashBytes(description.data(), description.size(), hashFile(modelPath));
+}
+
+DetectionCache::DetectionCache(std::string file, uint64_t configHash)
+{
+    path = file;
+    config = configHash;
+
+    size_t fileSize = std::filesystem::exists(path) ? (size_t)std::filesystem::file_size(path) : 0,
+           valid = fileSize > 0 ? load() : 0;
+    if (valid < fileSize)
+    {
+        // drop a record cut by an interrupted run so appends stay aligned
+        std::cerr << LogWarning("Cache", "Dropping truncated tail of " + path) << std::endl;
+        std::filesystem::resize_file(path, valid);
+    }
+
+    out = std::fopen(path.c_str(), "ab");
+    if (out == nullptr)
+    {
+        std::cerr << LogError("Cache", "Can't open " + path + " for writing") << std::endl;
+        std::abort();
+    }
+    if (valid == 0)
+    {
+        std::fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), out);
+        std::fflush(out);
+    }
+}
+
+size_t DetectionCache::load()
+{
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            mapped = (const uchar *)p;
+            mappedSize = (size_t)st.st_size;
+        }
+    }
+    if (fd >= 0)
+        close(fd);
+#endif
+    if (mapped == nullptr)
+    {
+        std::ifstream f(path, std::ios::binary);
+        fallback.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+        mapped = (const uchar *)fallback.data();
+        mappedSize = fallback.size();
+    }
+
+    if (mappedSize < sizeof(CACHE_MAGIC) || std::memcmp(mapped, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0)
+    {
+        std::cerr << LogError("Cache", path + " isn't a detection cache file") << std::endl;
+        std::abort();
+    }
+
+    size_t pos = sizeof(CACHE_MAGIC);
+    while (pos + sizeof(RecordHeader) <= mappedSize)
+    {
+        RecordHeader header;
+        std::memcpy(&header, mapped + pos, sizeof(header));
+        size_t end = pos + sizeof(header) + (size_t)header.count * sizeof(DetectionRecord);
+        if (end > mappedSize)
+            break;
+
+        if (header.config == config)
+            index[header.content] = {pos + sizeof(header), header.count};
+        pos = end;
+    }
+    return pos;
+}
+
+DetectionCache::~DetectionCache()
+{
+    if (out != nullptr)
+        std::fclose(out);
+#ifndef _WIN32
+    if (mapped != nullptr && fallback.empty())
+        munmap((void *)mapped, mappedSize);
+#endif
+}
+
+bool DetectionCache::lookup(uint64_t content, std::vector<Detection> &detections)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto recent = appended.find(content);
+    if (recent != appended.end())
+    {
+        detections = recent->second;
+        hits++;
+        return true;
+    }
+
+    auto entry = index.find(content);
+    if (entry == index.end())
+    {
+        misses++;
+        return false;
+    }
+
+    detections.clear();
+    for (uint32_t i = 0; i < entry->second.count; i++)
+    {
+        DetectionRecord record;
+        std::memcpy(&record, mapped + entry->second.offset + i * sizeof(DetectionRecord), sizeof(record));
+        detections.push_back(fromRecord(record));
+    }
+    hits++;
+    return true;
+}
+
+void DetectionCache::insert(uint64_t content, const std::vector<Detection> &detections)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    RecordHeader header{content, config, (uint32_t)detections.size(), 0};
+    std::fwrite(&header, sizeof(header), 1, out);
+    for (auto &det : detections)
+    {
+        DetectionRecord record = toRecord(det);
+        std::fwrite(&record, sizeof(record), 1, out);
+    }
+    std::fflush(out);
+    appended[content] = detections;
+}
+
+size_t DetectionCache::size()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    size_t n = appended.size();
+    for (auto &[content, entry] : index)
+        if (appended.find(content) == appended.end())
+            n++;
+    return n;
+}
+
+std::string DetectionCache::stats()
+{
+    uint64_t h = hits, m = misses;
+    std::ostringstream out;
+    out << "hits=" << h << " misses=" << m << " hit-rate=" << std::fixed << std::setprecision(1)
+        << (h + m > 0 ? 100.0 * (double)h / (double)(h + m) : 0.0) << "% entries=" << size();
+    return out.str();
+}
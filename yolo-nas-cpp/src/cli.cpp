@@ -1,4 +1,5 @@
 #include <argparse/argparse.hpp>
+#include <filesystem>
 #include <fstream>
 
 #include "utils.hpp"
@@ -6,14 +7,143 @@
 
 #define EXTRACT(x, j) x = j[#x].get<decltype(x)>()
 
+void parseMetadata(std::string path, Net &net, Processing &processing)
+{
+    exists(path);
+
+    std::ifstream f(path);
+    json metadata = json::parse(f);
+
+    std::vector<int> original_insz;
+    EXTRACT(original_insz, metadata);
+    processing.inputShape = {original_insz[3], original_insz[2]};
+
+    float iou_thres, score_thres;
+    EXTRACT(iou_thres, metadata);
+    EXTRACT(score_thres, metadata);
+    processing.iouThresh = iou_thres;
+    processing.scoreThresh = score_thres;
+
+    processing.PrepSteps = metadata["prep_steps"];
+    if (metadata.contains("input_channel_order"))
+        processing.swapRB = metadata["input_channel_order"].get<std::string>() != "BGR";
+
+    if (metadata.contains("classes"))
+        for (auto &c : metadata["classes"])
+            processing.classes.push_back(c.is_string() ? c.get<std::string>() : std::to_string(c.get<int>()));
+    if (metadata.contains("class_thresh"))
+        processing.classThresh = metadata["class_thresh"].get<std::map<std::string, float>>();
+
+    if (metadata.contains("labels"))
+    {
+        std::vector<std::string> labels;
+        EXTRACT(labels, metadata);
+        net.labels = labels;
+    }
+}
+
+void addThreadingArgs(argparse::ArgumentParser &program)
+{
+    program.add_argument("--threads-inference")
+        .help("Number of threads used by the model forward pass [default: OpenCV default]")
+        .scan<'i', int>();
+    program.add_argument("--threads-preprocess")
+        .help("Number of parallel stripes used by preprocessing, images and frames use the fused path [default: same as inference]")
+        .scan<'i', int>();
+    program.add_argument("--threads-io")
+        .help("Number of video decoder threads [default: backend default]")
+        .scan<'i', int>();
+    program.add_argument("--cpus")
+        .help("Pin to cpu list(s), e.g. '0-7' or '0-7 8-15' to pin each replica to its own set")
+        .nargs(argparse::nargs_pattern::at_least_one);
+    program.add_argument("--numa-nodes")
+        .help("Pin to the cpus of NUMA node(s), replicas are distributed round robin across nodes")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .scan<'i', int>();
+}
+
+Threading parseThreadingArgs(argparse::ArgumentParser &program)
+{
+    Threading threading;
+    auto inferenceArgs = program.present<int>("--threads-inference"),
+         preprocessArgs = program.present<int>("--threads-preprocess"),
+         ioArgs = program.present<int>("--threads-io");
+    auto cpusArgs = program.present<std::vector<std::string>>("--cpus");
+    auto numaArgs = program.present<std::vector<int>>("--numa-nodes");
+
+    threading.inference = inferenceArgs ? inferenceArgs.value() : 0;
+    threading.preprocess = preprocessArgs ? preprocessArgs.value() : 0;
+    threading.io = ioArgs ? ioArgs.value() : 0;
+
+    if (cpusArgs && numaArgs)
+    {
+        std::cerr << LogError("Double Entry", "Please specify either --cpus or --numa-nodes!") << std::endl;
+        std::abort();
+    }
+    if (cpusArgs)
+        for (auto &list : cpusArgs.value())
+            threading.cpus.push_back(parseCPUList(list));
+    if (numaArgs)
+        for (auto &node : numaArgs.value())
+            threading.cpus.push_back(numaNodeCPUs(node));
+
+    return threading;
+}
+
+void addClassArgs(argparse::ArgumentParser &program)
+{
+    program.add_argument("--classes")
+        .help("Only detect these classes, label names or indices [default: all classes]")
+        .nargs(argparse::nargs_pattern::at_least_one);
+    program.add_argument("--class-thresh")
+        .help("Per class score threshold as <CLASS>=<THRESH>, e.g. person=0.4 car=0.3")
+        .nargs(argparse::nargs_pattern::at_least_one);
+}
+
+void parseClassArgs(argparse::ArgumentParser &program, Processing &processing)
+{
+    auto classesArgs = program.present<std::vector<std::string>>("--classes"),
+         classThreshArgs = program.present<std::vector<std::string>>("--class-thresh");
+
+    if (classesArgs)
+        processing.classes = classesArgs.value();
+    if (classThreshArgs)
+        for (auto &entry : classThreshArgs.value())
+        {
+            size_t sep = entry.rfind('=');
+            try
+            {
+                if (sep == std::string::npos || sep == 0)
+                    throw std::invalid_argument(entry);
+                processing.classThresh[entry.substr(0, sep)] = std::stof(entry.substr(sep + 1));
+            }
+            catch (const std::exception &)
+            {
+                std::cerr << LogError("Class Threshold", "Expected <CLASS>=<THRESH>, got " + entry) << std::endl;
+                std::abort();
+            }
+        }
+}
+
 Config parseCLI(int argc, char **argv)
 {
     argparse::ArgumentParser program("yolo-nas-cpp");
     program.add_description("Detect using YOLO-NAS model");
 
     program.add_argument("model").help("Path to the YOLO-NAS ONNX model.").metavar("MODEL");
-    program.add_argument("-I", "--image").help("Path to the image source").metavar("IMAGE");
+    program.add_argument("-I", "--image").help("Path to the image source (or a directory of images)").metavar("IMAGE");
     program.add_argument("-V", "--video").help("Path to the video source").metavar("VIDEO");
+    program.add_argument("-R", "--raw").help("Read raw frames from stdin ('-') or a named pipe").metavar("RAW");
+    program.add_argument("--raw-size")
+        .help("Raw frame size (width height)")
+        .nargs(2)
+        .scan<'i', int>();
+    program.add_argument("--raw-format")
+        .default_value(std::string("bgr"))
+        .help("Raw frame pixel format (bgr | rgb | nv12 | i420)");
+    program.add_argument("--output-format")
+        .default_value(std::string("jsonl"))
+        .help("Detections written to stdout on raw source (jsonl | binary)");
 
     program.add_argument("--imgsz")
         .help("Model input size [default: {640 640}]")
@@ -30,10 +160,24 @@ Config parseCLI(int argc, char **argv)
         .help("Float representing the threshold for deciding whether boxes overlap too much with respect to IOU [default: 0.45]")
         .scan<'g', float>();
 
+    addClassArgs(program);
+
     program.add_argument("--export")
-        .help("Export to a file (path with extension | mp4 is a must for video)");
+        .help("Export to a file (path with extension | mp4 is a must for video | directory for image directory)");
+    program.add_argument("--cache")
+        .help("Path to a persistent detection cache file, skips inference on already processed images");
     program.add_argument("--custom-metadata")
         .help("Path to metadata file (Generated from https://gist.github.com/Hyuto/f3db1c0c2c36308284e101f441c2555f)");
+    addThreadingArgs(program);
+
+    program.add_argument("--metrics-port")
+        .help("Serve Prometheus metrics on http://127.0.0.1:<PORT>/metrics")
+        .scan<'i', int>();
+    program.add_argument("--metrics-json")
+        .help("Periodically dump metrics as json to a file");
+    program.add_argument("--metrics-interval")
+        .help("Seconds between json metrics dumps [default: 5]")
+        .scan<'g', double>();
 
     try
     {
@@ -50,20 +194,22 @@ Config parseCLI(int argc, char **argv)
     bool useGPU = program.get<bool>("--gpu");
     auto imgPathArgs = program.present<std::string>("-I"),
          vidPathArgs = program.present<std::string>("-V"),
+         rawPathArgs = program.present<std::string>("-R"),
          customMetadataArgs = program.present<std::string>("--custom-metadata"),
-         exportArgs = program.present<std::string>("--export");
+         exportArgs = program.present<std::string>("--export"),
+         cacheArgs = program.present<std::string>("--cache");
     auto scoreThreshArgs = program.present<float>("--score-thresh"),
          iouThreshArgs = program.present<float>("--iou-thresh");
     auto imgSizeArgs = program.present<std::vector<int>>("--imgsz");
 
-    if (imgPathArgs && vidPathArgs)
+    if ((int)(bool)imgPathArgs + (int)(bool)vidPathArgs + (int)(bool)rawPathArgs > 1)
     {
-        std::cerr << LogError("Double Entry", "Please specify either image or video source!") << std::endl;
+        std::cerr << LogError("Double Entry", "Please specify either image, video or raw source!") << std::endl;
         std::abort();
     }
-    else if (!(imgPathArgs || vidPathArgs))
+    else if (!(imgPathArgs || vidPathArgs || rawPathArgs))
     {
-        std::cerr << LogError("No Entry", "Please input either image or video source!") << std::endl;
+        std::cerr << LogError("No Entry", "Please input either image, video or raw source!") << std::endl;
         std::abort();
     }
 
@@ -71,7 +217,7 @@ Config parseCLI(int argc, char **argv)
     if (imgPathArgs)
     {
         exists(imgPathArgs.value());
-        source.type = IMAGE;
+        source.type = std::filesystem::is_directory(imgPathArgs.value()) ? DIRECTORY : IMAGE;
         source.path = imgPathArgs.value();
     }
     else if (vidPathArgs)
@@ -82,32 +228,66 @@ Config parseCLI(int argc, char **argv)
         source.type = VIDEO;
         source.path = vidPath;
     }
-
-    Processing processing;
-    Net net;
-    if (customMetadataArgs)
+    else if (rawPathArgs)
     {
-        exists(customMetadataArgs.value());
+        if (rawPathArgs.value() != "-")
+            exists(rawPathArgs.value());
+        source.type = STREAM;
+        source.path = rawPathArgs.value();
 
-        std::ifstream f(customMetadataArgs.value());
-        json metadata = json::parse(f);
+        auto rawSizeArgs = program.present<std::vector<int>>("--raw-size");
+        if (!rawSizeArgs || rawSizeArgs.value()[0] <= 0 || rawSizeArgs.value()[1] <= 0)
+        {
+            std::cerr << LogError("Raw Stream", "Please specify the frame size with --raw-size <WIDTH> <HEIGHT>!") << std::endl;
+            std::abort();
+        }
+        source.width = rawSizeArgs.value()[0];
+        source.height = rawSizeArgs.value()[1];
 
-        std::vector<int> original_insz;
-        EXTRACT(original_insz, metadata);
-        processing.inputShape = {original_insz[3], original_insz[2]};
-
-        float iou_thres, score_thres;
-        EXTRACT(iou_thres, metadata);
-        EXTRACT(score_thres, metadata);
-        processing.iouThresh = iouThreshArgs ? iouThreshArgs.value() : iou_thres;
-        processing.scoreThresh = scoreThreshArgs ? iouThreshArgs.value() : score_thres;
+        std::string rawFormat = program.get<std::string>("--raw-format");
+        if (rawFormat == "bgr")
+            source.format = FMT_BGR;
+        else if (rawFormat == "rgb")
+            source.format = FMT_RGB;
+        else if (rawFormat == "nv12")
+            source.format = FMT_NV12;
+        else if (rawFormat == "i420")
+            source.format = FMT_I420;
+        else
+        {
+            std::cerr << LogError("Raw Stream", "Unknown pixel format " + rawFormat) << std::endl;
+            std::abort();
+        }
+        if ((source.format == FMT_NV12 || source.format == FMT_I420) && (source.width % 2 || source.height % 2))
+        {
+            std::cerr << LogError("Raw Stream", "nv12 and i420 frames must have even width and height!") << std::endl;
+            std::abort();
+        }
+        if (exportArgs || cacheArgs)
+        {
+            std::cerr << LogError("Raw Stream", "--export and --cache aren't supported on raw source!") << std::endl;
+            std::abort();
+        }
+    }
 
-        processing.PrepSteps = metadata["prep_steps"];
+    std::string outputFormat = program.get<std::string>("--output-format");
+    if (outputFormat != "jsonl" && outputFormat != "binary")
+    {
+        std::cerr << LogError("Output Format", "Unknown output format " + outputFormat) << std::endl;
+        std::abort();
+    }
 
-        std::vector<std::string> labels;
-        EXTRACT(labels, metadata);
-        net.labels = labels;
+    Processing processing;
+    Net net;
+    if (customMetadataArgs)
+    {
+        parseMetadata(customMetadataArgs.value(), net, processing);
+        if (iouThreshArgs)
+            processing.iouThresh = iouThreshArgs.value();
+        if (scoreThreshArgs)
+            processing.scoreThresh = scoreThreshArgs.value();
     }
+    parseClassArgs(program, processing);
 
     if (imgSizeArgs)
     {
@@ -117,7 +297,7 @@ Config parseCLI(int argc, char **argv)
 
         if (processing.inputShape.size() == 2)
             if (!(imgsz == processing.inputShape))
-                std::cout << LogWarning("Input Size", "Input size is different from Original Input size from metadata. This will lead to low detection performance or Runtime Error!") << std::endl;
+                std::cerr << LogWarning("Input Size", "Input size is different from Original Input size from metadata. This will lead to low detection performance or Runtime Error!") << std::endl;
         processing.inputShape = imgsz;
     }
     else if (processing.inputShape.size() == 0)
@@ -136,21 +316,72 @@ Config parseCLI(int argc, char **argv)
 
     std::string exportPath = exportArgs ? exportArgs.value() : "";
 
-    Config configurations{net, source, processing, exportPath};
+    Monitoring monitoring;
+    auto metricsPortArgs = program.present<int>("--metrics-port");
+    auto metricsJsonArgs = program.present<std::string>("--metrics-json");
+    auto metricsIntervalArgs = program.present<double>("--metrics-interval");
+    monitoring.port = metricsPortArgs ? metricsPortArgs.value() : 0;
+    monitoring.jsonPath = metricsJsonArgs ? metricsJsonArgs.value() : "";
+    if (metricsIntervalArgs)
+    {
+        if (metricsIntervalArgs.value() < 0.001)
+        {
+            std::cerr << LogError("Metrics", "--metrics-interval must be at least 0.001 seconds!") << std::endl;
+            std::abort();
+        }
+        monitoring.interval = metricsIntervalArgs.value();
+    }
 
-    std::string emoji = configurations.source.type == IMAGE ? "🖼️" : "📷";
-    std::cout << emoji + LogInfo(" Detect", "model=" + configurations.net.path);
-    std::cout << " source=" + configurations.source.path;
-    std::cout << " imgsz="
-              << "[" << configurations.processing.inputShape[0] << "," << configurations.processing.inputShape[1] << "]";
-    std::cout << " gpu=" << (configurations.net.gpu ? "true" : "false");
-    std::cout << " score-thresh=" << configurations.processing.scoreThresh;
-    std::cout << " iou-thresh=" << configurations.processing.iouThresh;
+    Config configurations{net, source, processing, exportPath, parseThreadingArgs(program), monitoring,
+                          cacheArgs ? cacheArgs.value() : "", outputFormat};
+
+    // stdout carries detections on directory and stream sources
+    std::ostream &log = configurations.source.type == DIRECTORY || configurations.source.type == STREAM ? std::cerr : std::cout;
+    std::string emoji = configurations.source.type == IMAGE       ? "🖼️"
+                        : configurations.source.type == VIDEO     ? "📷"
+                        : configurations.source.type == DIRECTORY ? "🗂️"
+                                                                  : "🎞️";
+    log << emoji + LogInfo(" Detect", "model=" + configurations.net.path);
+    log << " source=" + configurations.source.path;
+    if (configurations.source.type == STREAM)
+        log << " raw-size=[" << configurations.source.width << "," << configurations.source.height << "]"
+            << " raw-format=" << program.get<std::string>("--raw-format") << " output-format=" << outputFormat;
+    log << " imgsz="
+        << "[" << configurations.processing.inputShape[0] << "," << configurations.processing.inputShape[1] << "]";
+    log << " gpu=" << (configurations.net.gpu ? "true" : "false");
+    log << " score-thresh=" << configurations.processing.scoreThresh;
+    log << " iou-thresh=" << configurations.processing.iouThresh;
+    if (configurations.processing.classes.size() > 0)
+    {
+        log << " classes=";
+        for (size_t i = 0; i < configurations.processing.classes.size(); i++)
+            log << (i > 0 ? "," : "") << configurations.processing.classes[i];
+    }
+    if (configurations.processing.classThresh.size() > 0)
+    {
+        log << " class-thresh=";
+        for (auto it = configurations.processing.classThresh.begin(); it != configurations.processing.classThresh.end(); ++it)
+            log << (it != configurations.processing.classThresh.begin() ? "," : "") << it->first << "=" << it->second;
+    }
     if (customMetadataArgs)
-        std::cout << " custom-metadata=" << customMetadataArgs.value();
+        log << " custom-metadata=" << customMetadataArgs.value();
     if (exportArgs)
-        std::cout << " export=" << exportPath;
-    std::cout << std::endl;
+        log << " export=" << exportPath;
+    if (configurations.threading.inference > 0)
+        log << " threads-inference=" << configurations.threading.inference;
+    if (configurations.threading.preprocess > 0)
+        log << " threads-preprocess=" << configurations.threading.preprocess;
+    if (configurations.threading.io > 0)
+        log << " threads-io=" << configurations.threading.io;
+    if (configurations.threading.cpus.size() > 0)
+        log << " cpus=" << describeCPUs(configurations.threading.cpus[0]);
+    if (monitoring.port > 0)
+        log << " metrics-port=" << monitoring.port;
+    if (monitoring.jsonPath != "")
+        log << " metrics-json=" << monitoring.jsonPath;
+    if (cacheArgs)
+        log << " cache=" << configurations.cachePath;
+    log << std::endl;
 
     return configurations;
 }
\ No newline at end of file
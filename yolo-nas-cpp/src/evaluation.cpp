@@ -0,0 +1,284 @@
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <numeric>
+
+#include "evaluation.hpp"
+#include "utils.hpp"
+
+CocoDataset::CocoDataset(std::string imageDir, std::string annotationPath, std::vector<std::string> &labels)
+{
+    exists(imageDir);
+    exists(annotationPath);
+
+    std::ifstream f(annotationPath);
+    json coco = json::parse(f);
+
+    // map COCO category ids (non contiguous) to model class index by name
+    std::map<int, int> categoryToClass;
+    std::vector<int> categoryIDs;
+    for (auto &category : coco["categories"])
+    {
+        int id = category["id"].get<int>();
+        std::string name = category["name"].get<std::string>();
+        categoryIDs.push_back(id);
+
+        auto label = std::find(labels.begin(), labels.end(), name);
+        if (label != labels.end())
+            categoryToClass[id] = (int)(label - labels.begin());
+    }
+
+    if (categoryToClass.empty() && categoryIDs.size() == labels.size())
+    {
+        std::cout << LogWarning("Dataset", "Category names don't match labels, mapping categories by sorted id.") << std::endl;
+        std::sort(categoryIDs.begin(), categoryIDs.end());
+        for (size_t i = 0; i < categoryIDs.size(); i++)
+            categoryToClass[categoryIDs[i]] = (int)i;
+    }
+    else if (categoryToClass.size() < categoryIDs.size())
+        std::cout << LogWarning("Dataset", std::to_string(categoryIDs.size() - categoryToClass.size()) +
+                                               " categories aren't in model labels and will be ignored.")
+                  << std::endl;
+
+    int missing = 0;
+    for (auto &image : coco["images"])
+    {
+        std::filesystem::path path = std::filesystem::path(imageDir) / image["file_name"].get<std::string>();
+        if (!std::filesystem::exists(path))
+        {
+            missing++;
+            continue;
+        }
+        images.push_back({image["id"].get<int>(), path.string()});
+    }
+    if (missing > 0)
+        std::cout << LogWarning("Dataset", std::to_string(missing) + " images listed in annotations aren't found and will be skipped.") << std::endl;
+
+    for (auto &ann : coco["annotations"])
+    {
+        auto category = categoryToClass.find(ann["category_id"].get<int>());
+        std::vector<float> bbox = ann["bbox"].get<std::vector<float>>();
+
+        Annotation annotation;
+        annotation.classID = category != categoryToClass.end() ? category->second : -1;
+        std::copy(bbox.begin(), bbox.begin() + 4, annotation.bbox);
+        annotation.crowd = ann.value("iscrowd", 0) == 1;
+        annotations[ann["image_id"].get<int>()].push_back(annotation);
+    }
+}
+
+CocoEvaluator::CocoEvaluator(CocoDataset &data, int classes) : dataset(data)
+{
+    numClasses = classes;
+    matches.resize(classes);
+    numGT.resize(classes, 0);
+}
+
+static double boxIoU(const Detection &det, const Annotation &gt)
+{
+    double dx0 = det.box.x, dy0 = det.box.y, dx1 = dx0 + det.box.width, dy1 = dy0 + det.box.height;
+    double gx0 = gt.bbox[0], gy0 = gt.bbox[1], gx1 = gx0 + gt.bbox[2], gy1 = gy0 + gt.bbox[3];
+
+    double iw = std::min(dx1, gx1) - std::max(dx0, gx0),
+           ih = std::min(dy1, gy1) - std::max(dy0, gy0);
+    if (iw <= 0 || ih <= 0)
+        return 0.0;
+
+    double inter = iw * ih,
+           detArea = (double)det.box.width * det.box.height,
+           unionArea = gt.crowd ? detArea : detArea + (double)gt.bbox[2] * gt.bbox[3] - inter;
+    return unionArea > 0 ? inter / unionArea : 0.0;
+}
+
+void CocoEvaluator::add(int imageID, std::vector<Detection> &detections)
+{
+    static const std::vector<Annotation> noAnnotations;
+    auto found = dataset.annotations.find(imageID);
+    const std::vector<Annotation> &annotations = found != dataset.annotations.end() ? found->second : noAnnotations;
+
+    std::vector<std::vector<Match>> imageMatches(numClasses);
+    std::vector<int> imageGT(numClasses, 0);
+
+    for (int c = 0; c < numClasses; c++)
+    {
+        std::vector<const Annotation *> gt;
+        for (auto &ann : annotations)
+            if (ann.classID == c)
+                gt.push_back(&ann);
+        std::vector<const Detection *> dt;
+        for (auto &det : detections)
+            if (det.classID == c)
+                dt.push_back(&det);
+        if (gt.empty() && dt.empty())
+            continue;
+
+        // crowd annotations go last, they only turn matching detections into ignored ones
+        std::stable_partition(gt.begin(), gt.end(), [](const Annotation *a)
+                              { return !a->crowd; });
+        std::stable_sort(dt.begin(), dt.end(), [](const Detection *a, const Detection *b)
+                         { return a->score > b->score; });
+        if (dt.size() > MAX_DETS)
+            dt.resize(MAX_DETS);
+
+        for (auto *ann : gt)
+            if (!ann->crowd)
+                imageGT[c]++;
+
+        std::vector<double> ious(dt.size() * gt.size());
+        for (size_t d = 0; d < dt.size(); d++)
+            for (size_t g = 0; g < gt.size(); g++)
+                ious[d * gt.size() + g] = boxIoU(*dt[d], *gt[g]);
+
+        std::vector<Match> &classMatches = imageMatches[c];
+        for (auto *det : dt)
+            classMatches.push_back({det->score, 0, 0});
+
+        for (int t = 0; t < NUM_IOU; t++)
+        {
+            double iouThresh = std::min(0.5 + 0.05 * t, 1 - 1e-10);
+            std::vector<bool> gtMatched(gt.size(), false);
+            for (size_t d = 0; d < dt.size(); d++)
+            {
+                double best = iouThresh;
+                int bestGT = -1;
+                for (size_t g = 0; g < gt.size(); g++)
+                {
+                    if (gtMatched[g] && !gt[g]->crowd)
+                        continue;
+                    if (bestGT > -1 && !gt[bestGT]->crowd && gt[g]->crowd)
+                        break;
+                    if (ious[d * gt.size() + g] < best)
+                        continue;
+                    best = ious[d * gt.size() + g];
+                    bestGT = (int)g;
+                }
+                if (bestGT == -1)
+                    continue;
+
+                gtMatched[bestGT] = true;
+                if (gt[bestGT]->crowd)
+                    classMatches[d].ignored |= (uint16_t)(1 << t);
+                else
+                    classMatches[d].tp |= (uint16_t)(1 << t);
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    for (int c = 0; c < numClasses; c++)
+    {
+        matches[c].insert(matches[c].end(), imageMatches[c].begin(), imageMatches[c].end());
+        numGT[c] += imageGT[c];
+    }
+}
+
+double CocoEvaluator::averagePrecision(std::vector<Match> &classMatches, int nGT, int iouIdx)
+{
+    std::vector<double> recall, precision;
+    double tp = 0, fp = 0;
+    for (auto &m : classMatches)
+    {
+        if (m.ignored & (1 << iouIdx))
+            continue;
+        if (m.tp & (1 << iouIdx))
+            tp++;
+        else
+            fp++;
+        recall.push_back(tp / nGT);
+        precision.push_back(tp / (tp + fp));
+    }
+
+    for (int i = (int)precision.size() - 1; i > 0; i--)
+        precision[i - 1] = std::max(precision[i - 1], precision[i]);
+
+    double ap = 0.0;
+    for (int r = 0; r <= 100; r++)
+    {
+        auto idx = std::lower_bound(recall.begin(), recall.end(), r / 100.0) - recall.begin();
+        if (idx < (long)precision.size())
+            ap += precision[idx];
+    }
+    return ap / 101.0;
+}
+
+json CocoEvaluator::summarize(std::vector<int> classes)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    double sum = 0, sum50 = 0, sum75 = 0;
+    int valid = 0;
+    json perClass = json::array();
+    for (int c = 0; c < numClasses; c++)
+    {
+        bool active = classes.empty() || std::find(classes.begin(), classes.end(), c) != classes.end();
+        if (numGT[c] == 0 || !active)
+        {
+            perClass.push_back(nullptr);
+            continue;
+        }
+
+        std::stable_sort(matches[c].begin(), matches[c].end(), [](const Match &a, const Match &b)
+                         { return a.score > b.score; });
+
+        double classSum = 0;
+        for (int t = 0; t < NUM_IOU; t++)
+        {
+            double ap = averagePrecision(matches[c], numGT[c], t);
+            classSum += ap;
+            if (t == 0)
+                sum50 += ap;
+            if (t == 5)
+                sum75 += ap;
+        }
+        sum += classSum / NUM_IOU;
+        perClass.push_back(classSum / NUM_IOU);
+        valid++;
+    }
+
+    // -1 when there is no ground truth at all (same as pycocotools)
+    if (valid == 0)
+        return {{"mAP", -1.0}, {"mAP50", -1.0}, {"mAP75", -1.0}, {"per_class", perClass}};
+    return {{"mAP", sum / valid}, {"mAP50", sum50 / valid}, {"mAP75", sum75 / valid}, {"per_class", perClass}};
+}
+
+void LatencyStats::add(double ms)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    samples.push_back(ms);
+}
+
+size_t LatencyStats::count()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return samples.size();
+}
+
+double LatencyStats::percentile(double p)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (samples.empty())
+        return 0.0;
+
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    double rank = p / 100.0 * (double)(sorted.size() - 1);
+    size_t lo = (size_t)std::floor(rank), hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - (double)lo);
+}
+
+json LatencyStats::summarize()
+{
+    double mean = 0.0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!samples.empty())
+            mean = std::accumulate(samples.begin(), samples.end(), 0.0) / (double)samples.size();
+    }
+
+    return {{"count", count()},
+            {"mean", mean},
+            {"p50", percentile(50)},
+            {"p90", percentile(90)},
+            {"p99", percentile(99)},
+            {"max", percentile(100)}};
+}
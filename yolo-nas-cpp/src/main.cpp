@@ -1,21 +1,67 @@
+#include <chrono>
 #include <iostream>
 #include <string>
+#include <memory>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 #include "utils.hpp"
 #include "cli.hpp"
+#include "metrics.hpp"
+#include "cache.hpp"
+#include "serialize.hpp"
+#include "stream.hpp"
 #include "yolo-nas.hpp"
 
 int main(int argc, char **argv)
 {
     Config args = parseCLI(argc, argv);
+    applyThreading(args.threading);
+    if (args.threading.cpus.size() > 1)
+        std::cerr << LogWarning("CPU Affinity", "Single replica, pinning to the first cpu set " +
+                                                    describeCPUs(args.threading.cpus[0]) + " and ignoring the others.")
+                  << std::endl;
+    if (args.threading.cpus.size() > 0)
+        pinThread(args.threading.cpus[0]);
+
     YoloNAS net(args.net.path, args.net.gpu, args.processing.PrepSteps,
                 args.processing.inputShape, args.processing.scoreThresh,
-                args.processing.iouThresh, args.net.labels);
+                args.processing.iouThresh, args.net.labels, args.processing.swapRB);
+    net.preprocess.threads = args.threading.preprocess;
+    net.filterClasses(args.processing.classes, args.processing.classThresh);
+
+    std::unique_ptr<MetricsServer> metricsServer;
+    std::unique_ptr<MetricsDumper> metricsDumper;
+    if (args.monitoring.port > 0)
+        metricsServer = std::make_unique<MetricsServer>(args.monitoring.port);
+    if (args.monitoring.jsonPath != "")
+        metricsDumper = std::make_unique<MetricsDumper>(args.monitoring.jsonPath, args.monitoring.interval);
+
+    std::unique_ptr<DetectionCache> cache;
+    if (args.cachePath != "")
+        cache = std::make_unique<DetectionCache>(args.cachePath, hashConfig(args.net.path, net.describe()));
 
     if (args.source.type == IMAGE)
     {
         cv::Mat img = cv::imread(args.source.path);
-        net.predict(img);
+        if (cache)
+        {
+            std::vector<uchar> bytes = readBytes(args.source.path);
+            uint64_t content = hashBytes(bytes.data(), bytes.size());
+            std::vector<Detection> detections;
+            if (!cache->lookup(content, detections))
+            {
+                detections = net.detect(img);
+                cache->insert(content, detections);
+            }
+            net.draw(img, detections);
+        }
+        else
+            net.predict(img);
 
         cv::namedWindow(args.source.path, cv::WINDOW_NORMAL);
         cv::imshow(args.source.path, img);
@@ -24,6 +70,7 @@ int main(int argc, char **argv)
         if (args.exportPath != "")
         {
             std::cout << LogInfo("Export Image", args.exportPath) << std::endl;
+            StageTimer timer(STAGE_ENCODE);
             cv::imwrite(args.exportPath, img);
         }
     }
@@ -31,15 +78,19 @@ int main(int argc, char **argv)
     {
         cv::VideoCapture cap;
         std::string name;
+        // decoder threads can only be set when the capture is opened
+        std::vector<int> openParams;
+        if (args.threading.io > 0)
+            openParams = {cv::CAP_PROP_N_THREADS, args.threading.io};
         if (isNumber(args.source.path))
         {
             int source = std::stoi(args.source.path);
-            cap = cv::VideoCapture(source);
+            cap = cv::VideoCapture(source, cv::CAP_ANY, openParams);
             name = "Webcam: " + args.source.path;
         }
         else
         {
-            cap = cv::VideoCapture(args.source.path);
+            cap = cv::VideoCapture(args.source.path, cv::CAP_ANY, openParams);
             name = args.source.path;
         }
 
@@ -49,6 +100,8 @@ int main(int argc, char **argv)
             std::cerr << LogError("Video Capture", "Error opening video stream or file") << std::endl;
             std::abort();
         }
+        if (args.threading.io > 0 && (int)cap.get(cv::CAP_PROP_N_THREADS) != args.threading.io)
+            std::cerr << LogWarning("Video Capture", "Backend ignored --threads-io, using its default decoder threads") << std::endl;
 
         cv::namedWindow(name, cv::WINDOW_AUTOSIZE);
         std::cout << LogInfo("Processing video", "press 'q' to exit.") << std::endl;
@@ -73,6 +126,82 @@ int main(int argc, char **argv)
         cap.release();
         writer.close();
     }
+    else if (args.source.type == DIRECTORY)
+    {
+        if (args.exportPath != "")
+            std::filesystem::create_directories(args.exportPath);
+
+        std::vector<std::string> images = listImages(args.source.path);
+        std::cerr << LogInfo("Processing directory", std::to_string(images.size()) + " images.") << std::endl;
+        for (auto &path : images)
+        {
+            // on cache hit the image is neither decoded nor inferred (unless it has to be exported)
+            std::vector<uchar> bytes = readBytes(path);
+            uint64_t content = cache ? hashBytes(bytes.data(), bytes.size()) : 0;
+            std::vector<Detection> detections;
+            cv::Mat img;
+            if (!cache || !cache->lookup(content, detections))
+            {
+                img = cv::imdecode(bytes, cv::IMREAD_COLOR);
+                if (img.empty())
+                {
+                    std::cerr << LogWarning("Image", "Can't decode " + path) << std::endl;
+                    metrics().frameDropped();
+                    continue;
+                }
+                detections = net.detect(img);
+                if (cache)
+                    cache->insert(content, detections);
+            }
+
+            json line{{"image", path}, {"detections", detectionsToJson(detections, args.net.labels)}};
+            std::cout << line.dump() << "\n";
+
+            if (args.exportPath != "")
+            {
+                if (img.empty())
+                    img = cv::imdecode(bytes, cv::IMREAD_COLOR);
+                net.draw(img, detections);
+                StageTimer timer(STAGE_ENCODE);
+                cv::imwrite((std::filesystem::path(args.exportPath) / std::filesystem::path(path).filename()).string(), img);
+            }
+        }
+        std::cout.flush();
+    }
+    else if (args.source.type == STREAM)
+    {
+        RawFrameReader reader(args.source.path, frameBytes(args.source.format, args.source.width, args.source.height));
+        bool binary = args.outputFormat == "binary";
+#ifdef _WIN32
+        if (binary)
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        std::cerr << LogInfo("Processing stream", "reading raw frames from " + args.source.path) << std::endl;
+
+        uint64_t frames = 0;
+        auto start = std::chrono::steady_clock::now();
+        const uchar *data;
+        while ((data = reader.next()) != nullptr)
+        {
+            ImageBuffer frame(data, args.source.width, args.source.height, args.source.format);
+            std::vector<Detection> detections = net.detect(frame);
+            reader.release(); // frame is already in the network blob, let the reader refill the slot
+
+            // flushed per frame so the next process in the pipeline gets detections as soon as they're ready
+            if (binary)
+                writeBinaryFrame(std::cout, frames, detections);
+            else
+                std::cout << json{{"frame", frames}, {"detections", detectionsToJson(detections, args.net.labels)}}.dump() << "\n";
+            std::cout.flush();
+            frames++;
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << LogInfo("Stream", std::to_string(frames) + " frames in " + std::to_string(seconds) + "s")
+                  << " throughput=" << (seconds > 0 ? (double)frames / seconds : 0.0) << " frames/s" << std::endl;
+    }
+    if (cache)
+        std::cerr << LogInfo("Cache", cache->stats()) << std::endl;
     cv::destroyAllWindows();
 
     return 0;
@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include "metrics.hpp"
+#include "utils.hpp"
+
+constexpr double Histogram::BOUNDS[];
+
+// label values in prometheus exposition format must escape backslash, double quote and newline
+static std::string escapeLabel(const std::string &value)
+{
+    std::string out;
+    for (char c : value)
+    {
+        if (c == '\\' || c == '"')
+            out += '\\';
+        if (c == '\n')
+            out += "\\n";
+        else
+            out += c;
+    }
+    return out;
+}
+
+void Histogram::observe(std::chrono::nanoseconds elapsed)
+{
+    double seconds = (double)elapsed.count() * 1e-9;
+    int i = 0;
+    while (i < NUM_BUCKETS && seconds > BOUNDS[i])
+        i++;
+
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumNanos.fetch_add((uint64_t)elapsed.count(), std::memory_order_relaxed);
+}
+
+Metrics &metrics()
+{
+    static Metrics instance;
+    return instance;
+}
+
+void Metrics::setLabels(const std::vector<std::string> &classLabels)
+{
+    // called once while building the nets, before any frame is counted
+    std::lock_guard<std::mutex> guard(registry);
+    if (detections && labels.size() == classLabels.size())
+        return;
+
+    labels = classLabels;
+    detections.reset(new std::atomic<uint64_t>[labels.size()]());
+}
+
+void Metrics::countDetection(int classID)
+{
+    if (detections && classID >= 0 && classID < (int)labels.size())
+        detections[classID].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::frameProcessed()
+{
+    framesProcessed.fetch_add(1, std::memory_order_relaxed);
+    windowFrames.fetch_add(1, std::memory_order_relaxed);
+
+    // fps over ~1 second windows, the thread that closes a window publishes it
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count(),
+            start = windowStart.load(std::memory_order_relaxed);
+    lastFrame.store(now, std::memory_order_relaxed);
+    if (now - start >= 1000000000 && windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed))
+        fps.store((double)windowFrames.exchange(0, std::memory_order_relaxed) * 1e9 / (double)(now - start),
+                  std::memory_order_relaxed);
+}
+
+// Windows are only closed by incoming frames, so the rate is checked at read time:
+// 0 once no frame arrived for a whole window, the open window rate while it's overdue.
+double Metrics::currentFps()
+{
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count(),
+            start = windowStart.load(std::memory_order_relaxed);
+    if (now - lastFrame.load(std::memory_order_relaxed) >= 1000000000)
+        return 0.0;
+    if (now - start < 1000000000)
+        return fps.load(std::memory_order_relaxed);
+    return (double)windowFrames.load(std::memory_order_relaxed) * 1e9 / (double)(now - start);
+}
+
+void Metrics::frameDropped()
+{
+    framesDropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::atomic<int64_t> &Metrics::queue(std::string name)
+{
+    std::lock_guard<std::mutex> guard(registry);
+    return queues.try_emplace(name, 0).first->second;
+}
+
+std::string Metrics::prometheus()
+{
+    std::ostringstream out;
+    out << "# HELP yolo_nas_stage_latency_seconds Latency of each pipeline stage.\n"
+        << "# TYPE yolo_nas_stage_latency_seconds histogram\n";
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        Histogram &h = stages[s];
+        std::string stage = "stage=\"" + STAGE_NAMES[s] + "\"";
+        uint64_t cumulative = 0;
+        for (int i = 0; i < Histogram::NUM_BUCKETS; i++)
+        {
+            cumulative += h.buckets[i].load(std::memory_order_relaxed);
+            out << "yolo_nas_stage_latency_seconds_bucket{" << stage << ",le=\"" << Histogram::BOUNDS[i] << "\"} " << cumulative << "\n";
+        }
+        cumulative += h.buckets[Histogram::NUM_BUCKETS].load(std::memory_order_relaxed);
+        out << "yolo_nas_stage_latency_seconds_bucket{" << stage << ",le=\"+Inf\"} " << cumulative << "\n"
+            << "yolo_nas_stage_latency_seconds_sum{" << stage << "} " << (double)h.sumNanos.load(std::memory_order_relaxed) * 1e-9 << "\n"
+            << "yolo_nas_stage_latency_seconds_count{" << stage << "} " << cumulative << "\n";
+    }
+
+    out << "# HELP yolo_nas_frames_processed_total Frames processed.\n"
+        << "# TYPE yolo_nas_frames_processed_total counter\n"
+        << "yolo_nas_frames_processed_total " << framesProcessed.load(std::memory_order_relaxed) << "\n"
+        << "# HELP yolo_nas_frames_dropped_total Frames dropped.\n"
+        << "# TYPE yolo_nas_frames_dropped_total counter\n"
+        << "yolo_nas_frames_dropped_total " << framesDropped.load(std::memory_order_relaxed) << "\n"
+        << "# HELP yolo_nas_fps Frames processed per second over the last window.\n"
+        << "# TYPE yolo_nas_fps gauge\n"
+        << "yolo_nas_fps " << currentFps() << "\n";
+
+    std::lock_guard<std::mutex> guard(registry);
+    out << "# HELP yolo_nas_detections_total Detections per class.\n"
+        << "# TYPE yolo_nas_detections_total counter\n";
+    for (size_t i = 0; i < labels.size(); i++)
+        out << "yolo_nas_detections_total{class=\"" << escapeLabel(labels[i]) << "\"} " << detections[i].load(std::memory_order_relaxed) << "\n";
+
+    out << "# HELP yolo_nas_queue_depth Items waiting in a queue.\n"
+        << "# TYPE yolo_nas_queue_depth gauge\n";
+    for (auto &[name, depth] : queues)
+        out << "yolo_nas_queue_depth{queue=\"" << escapeLabel(name) << "\"} " << depth.load(std::memory_order_relaxed) << "\n";
+
+    return out.str();
+}
+
+json Metrics::toJson()
+{
+    json out{{"frames_processed", framesProcessed.load(std::memory_order_relaxed)},
+             {"frames_dropped", framesDropped.load(std::memory_order_relaxed)},
+             {"fps", currentFps()},
+             {"stages", json::object()},
+             {"detections", json::object()},
+             {"queues", json::object()}};
+
+    for (int s = 0; s < STAGE_COUNT; s++)
+    {
+        Histogram &h = stages[s];
+        uint64_t count = h.count.load(std::memory_order_relaxed);
+        double sum = (double)h.sumNanos.load(std::memory_order_relaxed) * 1e-9;
+
+        json buckets = json::object();
+        for (int i = 0; i < Histogram::NUM_BUCKETS; i++)
+            buckets[std::to_string(Histogram::BOUNDS[i])] = h.buckets[i].load(std::memory_order_relaxed);
+        buckets["+Inf"] = h.buckets[Histogram::NUM_BUCKETS].load(std::memory_order_relaxed);
+
+        out["stages"][STAGE_NAMES[s]] = {{"count", count},
+                                         {"sum_seconds", sum},
+                                         {"mean_ms", count > 0 ? sum * 1000.0 / (double)count : 0.0},
+                                         {"buckets", buckets}};
+    }
+
+    std::lock_guard<std::mutex> guard(registry);
+    for (size_t i = 0; i < labels.size(); i++)
+        out["detections"][labels[i]] = detections[i].load(std::memory_order_relaxed);
+    for (auto &[name, depth] : queues)
+        out["queues"][name] = depth.load(std::memory_order_relaxed);
+
+    return out;
+}
+
+StageTimer::StageTimer(Stage s)
+{
+    stage = s;
+    start = std::chrono::steady_clock::now();
+}
+
+StageTimer::~StageTimer()
+{
+    metrics().stages[stage].observe(std::chrono::steady_clock::now() - start);
+}
+
+MetricsServer::MetricsServer(int port)
+{
+#ifndef _WIN32
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0)
+    {
+        std::cerr << LogWarning("Metrics", "Can't listen on 127.0.0.1:" + std::to_string(port) + ", endpoint disabled.") << std::endl;
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+        return;
+    }
+
+    running = true;
+    worker = std::thread(&MetricsServer::serve, this);
+    std::cerr << LogInfo("Metrics", "http://127.0.0.1:" + std::to_string(port) + "/metrics") << std::endl;
+#else
+    std::cerr << LogWarning("Metrics", "HTTP endpoint isn't supported on windows, use json dumps instead.") << std::endl;
+#endif
+}
+
+void MetricsServer::serve()
+{
+#ifndef _WIN32
+    while (running)
+    {
+        pollfd p{fd, POLLIN, 0};
+        if (poll(&p, 1, 200) <= 0)
+            continue;
+
+        int client = accept(fd, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        // a client that stalls mustn't block other scrapes or shutdown
+        timeval timeout{1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        char buffer[1024];
+        ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+        std::string request(buffer, n > 0 ? (size_t)n : 0);
+        std::string target = request.substr(0, request.find('\r'));
+
+        std::string status = "200 OK", type = "text/plain; version=0.0.4", body;
+        if (target.rfind("GET /metrics.json ", 0) == 0)
+        {
+            type = "application/json";
+            body = metrics().toJson().dump();
+        }
+        else if (target.rfind("GET /metrics ", 0) == 0 || target.rfind("GET / ", 0) == 0)
+            body = metrics().prometheus();
+        else
+        {
+            status = "404 Not Found";
+            body = "not found\n";
+        }
+
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: " + type +
+                               "\r\nContent-Length: " + std::to_string(body.size()) +
+                               "\r\nConnection: close\r\n\r\n" + body;
+#ifdef MSG_NOSIGNAL
+        int flags = MSG_NOSIGNAL;
+#else
+        int flags = 0;
+#endif
+        size_t sent = 0;
+        while (sent < response.size())
+        {
+            ssize_t k = send(client, response.data() + sent, response.size() - sent, flags);
+            if (k <= 0)
+                break;
+            sent += (size_t)k;
+        }
+        close(client);
+    }
+#endif
+}
+
+MetricsServer::~MetricsServer()
+{
+    running = false;
+    if (worker.joinable())
+        worker.join();
+#ifndef _WIN32
+    if (fd >= 0)
+        close(fd);
+#endif
+}
+
+MetricsDumper::MetricsDumper(std::string file, double seconds)
+{
+    path = file;
+    interval = std::chrono::milliseconds(std::max((long long)(seconds * 1000), 1LL));
+    worker = std::thread([this]()
+                         {
+        std::unique_lock<std::mutex> guard(lock);
+        while (running)
+        {
+            wake.wait_for(guard, interval);
+            dump();
+        } });
+}
+
+void MetricsDumper::dump()
+{
+    // write then rename so readers never see a partial file
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp);
+        f << metrics().toJson().dump(2) << std::endl;
+    }
+    std::error_code err;
+    std::filesystem::rename(tmp, path, err);
+}
+
+MetricsDumper::~MetricsDumper()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        running = false;
+    }
+    wake.notify_all();
+    worker.join();
+}
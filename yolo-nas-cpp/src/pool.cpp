@@ -0,0 +1,43 @@
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "pool.hpp"
+#include "metrics.hpp"
+#include "threading.hpp"
+
+WorkerPool::WorkerPool(int n, std::vector<std::vector<int>> cpuSets)
+{
+    workers = std::max(n, 1);
+    cpus = cpuSets;
+    depth = &metrics().queue("worker_pool");
+}
+
+void WorkerPool::run(size_t count, std::function<void(int)> worker)
+{
+    total = count;
+    cursor = 0;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < workers; i++)
+        threads.emplace_back([this, &worker, i]()
+                             {
+            if (!cpus.empty())
+                pinThread(cpus[i % cpus.size()]);
+            worker(i); });
+    for (auto &t : threads)
+        t.join();
+}
+
+bool WorkerPool::next(size_t &item)
+{
+    item = cursor.fetch_add(1, std::memory_order_relaxed);
+    depth->store((int64_t)pending(), std::memory_order_relaxed);
+    return item < total;
+}
+
+size_t WorkerPool::pending()
+{
+    size_t taken = cursor.load(std::memory_order_relaxed);
+    return taken < total ? total - taken : 0;
+}
@@ -1,13 +1,15 @@
+#include <algorithm>
 #include <opencv2/dnn.hpp>
 
 #include "processing.hpp"
+#include "metrics.hpp"
 #include "utils.hpp"
 
 #define EXTRACT(x, j) x = j[#x].get<decltype(x)>()
 
 PreProcessing::PreProcessing() {}
 
-PreProcessing::PreProcessing(json &steps, std::vector<int> shape)
+PreProcessing::PreProcessing(json &steps, std::vector<int> shape, bool swap)
 {
     if (!steps.is_null())
     {
@@ -18,6 +20,14 @@ PreProcessing::PreProcessing(json &steps, std::vector<int> shape)
     }
 
     outShape = cv::Size(shape[0], shape[1]);
+    swapRB = swap;
+
+    // without Standardize / Normalize (e.g. folded into the model) the blob is a plain cast of the pixels,
+    // so keep it 8 bit and let the net convert it
+    blobDepth = CV_8U;
+    for (auto &step : prepSteps)
+        if (step.contains("Standardize") || step.contains("Normalize"))
+            blobDepth = CV_32F;
 }
 
 void PreProcessing::rescaleImage(cv::Mat &img, cv::Mat &dst, cv::Size size)
@@ -119,14 +129,296 @@ void PreProcessing::_call_fn(std::string name, cv::Mat &source, cv::Mat &dst, js
 
 json PreProcessing::run(cv::Mat &img, cv::Mat &dst)
 {
-    img.copyTo(dst);
+    cv::Mat work;
+    img.copyTo(work);
 
     json metadata;
     for (auto &step : prepSteps)
         for (auto &[name, kwargs] : step.items())
-            _call_fn(name, dst, dst, kwargs, metadata);
+            _call_fn(name, work, work, kwargs, metadata);
 
-    cv::dnn::blobFromImage(dst, dst, 1, cv::Size(), cv::Scalar(), true, false);
+    cv::dnn::blobFromImage(work, dst, 1, cv::Size(), cv::Scalar(), swapRB, false, blobDepth);
+
+    return metadata;
+}
+
+ImageBuffer::ImageBuffer() {}
+
+ImageBuffer::ImageBuffer(const uchar *data, int w, int h, PixelFormat fmt, size_t stride)
+{
+    format = fmt;
+    width = w;
+    height = h;
+    planes[0] = data;
+
+    if (fmt == FMT_BGR || fmt == FMT_RGB)
+        strides[0] = stride ? stride : (size_t)w * 3;
+    else if (fmt == FMT_NV12)
+    {
+        // interleaved UV row holds ceil(w / 2) pairs, one byte longer than the Y row on odd widths
+        strides[0] = stride ? stride : (size_t)w;
+        strides[1] = stride ? stride : (size_t)(2 * ((w + 1) / 2));
+        planes[1] = data + strides[0] * h;
+    }
+    else if (fmt == FMT_I420)
+    {
+        strides[0] = stride ? stride : (size_t)w;
+        strides[1] = strides[2] = (strides[0] + 1) / 2;
+        planes[1] = data + strides[0] * h;
+        planes[2] = planes[1] + strides[1] * ((h + 1) / 2);
+    }
+}
+
+struct LinearTap
+{
+    int i0;
+    int i1;
+    float w;
+};
+
+// Same sampling grid as cv::resize INTER_LINEAR (half-pixel centers, clamped borders)
+static LinearTap linearTap(double f, int srcLen)
+{
+    int i0 = (int)std::floor(f);
+    float w = (float)(f - i0);
+    if (i0 < 0)
+    {
+        i0 = 0;
+        w = 0.0f;
+    }
+    if (i0 >= srcLen - 1)
+    {
+        i0 = srcLen - 1;
+        w = 0.0f;
+    }
+    return {i0, std::min(i0 + 1, srcLen - 1), w};
+}
+
+static inline float lerp2(const uchar *r0, const uchar *r1, int i0, int i1, float wx, float wy)
+{
+    float top = r0[i0] + (r0[i1] - r0[i0]) * wx,
+          bot = r1[i0] + (r1[i1] - r1[i0]) * wx;
+    return top + (bot - top) * wy;
+}
+
+template <typename T>
+static void sampleRow(ImageBuffer &img, LinearTap &ty, LinearTap &tcy,
+                      std::vector<LinearTap> &tx, std::vector<LinearTap> &tcx,
+                      T *out[3], const float *ka, const float *kb)
+{
+    int n = (int)tx.size();
+    if (img.format == FMT_BGR || img.format == FMT_RGB)
+    {
+        const uchar *r0 = img.planes[0] + img.strides[0] * ty.i0,
+                    *r1 = img.planes[0] + img.strides[0] * ty.i1;
+        int ib = img.format == FMT_BGR ? 0 : 2,
+            ir = 2 - ib;
+        for (int x = 0; x < n; x++)
+        {
+            LinearTap &t = tx[x];
+            int i0 = t.i0 * 3, i1 = t.i1 * 3;
+            out[0][x] = cv::saturate_cast<T>(lerp2(r0 + ir, r1 + ir, i0, i1, t.w, ty.w) * ka[0] + kb[0]);
+            out[1][x] = cv::saturate_cast<T>(lerp2(r0 + 1, r1 + 1, i0, i1, t.w, ty.w) * ka[1] + kb[1]);
+            out[2][x] = cv::saturate_cast<T>(lerp2(r0 + ib, r1 + ib, i0, i1, t.w, ty.w) * ka[2] + kb[2]);
+        }
+        return;
+    }
+
+    const uchar *y0 = img.planes[0] + img.strides[0] * ty.i0,
+                *y1 = img.planes[0] + img.strides[0] * ty.i1,
+                *u0 = img.planes[1] + img.strides[1] * tcy.i0,
+                *u1 = img.planes[1] + img.strides[1] * tcy.i1,
+                *v0, *v1;
+    int cstep;
+    if (img.format == FMT_NV12)
+    {
+        v0 = u0 + 1;
+        v1 = u1 + 1;
+        cstep = 2;
+    }
+    else
+    {
+        v0 = img.planes[2] + img.strides[2] * tcy.i0;
+        v1 = img.planes[2] + img.strides[2] * tcy.i1;
+        cstep = 1;
+    }
+
+    for (int x = 0; x < n; x++)
+    {
+        LinearTap &t = tx[x], &tc = tcx[x];
+        int c0 = tc.i0 * cstep, c1 = tc.i1 * cstep;
+        float Y = 1.164f * (lerp2(y0, y1, t.i0, t.i1, t.w, ty.w) - 16.0f),
+              U = lerp2(u0, u1, c0, c1, tc.w, tcy.w) - 128.0f,
+              V = lerp2(v0, v1, c0, c1, tc.w, tcy.w) - 128.0f;
+
+        // BT.601 limited range, same coefficients as cv::COLOR_YUV2BGR_NV12
+        float R = std::min(std::max(Y + 1.596f * V, 0.0f), 255.0f),
+              G = std::min(std::max(Y - 0.813f * V - 0.391f * U, 0.0f), 255.0f),
+              B = std::min(std::max(Y + 2.018f * U, 0.0f), 255.0f);
+        out[0][x] = cv::saturate_cast<T>(R * ka[0] + kb[0]);
+        out[1][x] = cv::saturate_cast<T>(G * ka[1] + kb[1]);
+        out[2][x] = cv::saturate_cast<T>(B * ka[2] + kb[2]);
+    }
+}
+
+// ka, kb and fill are indexed R, G, B
+template <typename T>
+static void fillBlob(ImageBuffer &img, cv::Mat &dst, cv::Rect content, bool swapRB,
+                     const float *ka, const float *kb, const float *fill, int threads)
+{
+    int height = dst.size[2], width = dst.size[3];
+    bool subsampled = img.format == FMT_NV12 || img.format == FMT_I420;
+    double rx = (double)img.width / content.width,
+           ry = (double)img.height / content.height;
+    std::vector<LinearTap> tx(content.width), tcx(subsampled ? content.width : 0);
+    for (int x = 0; x < content.width; x++)
+    {
+        double f = (x + 0.5) * rx - 0.5;
+        tx[x] = linearTap(f, img.width);
+        if (subsampled)
+            tcx[x] = linearTap((f + 0.5) / 2 - 0.5, (img.width + 1) / 2);
+    }
+
+    T *base = (T *)dst.data;
+    T fillValue[3] = {cv::saturate_cast<T>(fill[0]), cv::saturate_cast<T>(fill[1]), cv::saturate_cast<T>(fill[2])};
+    size_t planeSize = (size_t)height * width;
+    cv::parallel_for_(cv::Range(0, height), [&](const cv::Range &range)
+                      {
+        for (int y = range.start; y < range.end; y++)
+        {
+            T *row[3];
+            for (int c = 0; c < 3; c++)
+                row[c] = base + (swapRB ? c : 2 - c) * planeSize + (size_t)y * width;
+
+            int cy = y - content.y;
+            if (cy < 0 || cy >= content.height)
+            {
+                for (int c = 0; c < 3; c++)
+                    std::fill(row[c], row[c] + width, fillValue[c]);
+                continue;
+            }
+
+            for (int c = 0; c < 3; c++)
+            {
+                std::fill(row[c], row[c] + content.x, fillValue[c]);
+                std::fill(row[c] + content.x + content.width, row[c] + width, fillValue[c]);
+                row[c] += content.x;
+            }
+
+            double f = (cy + 0.5) * ry - 0.5;
+            LinearTap ty = linearTap(f, img.height),
+                      tcy = subsampled ? linearTap((f + 0.5) / 2 - 0.5, (img.height + 1) / 2) : ty;
+            sampleRow(img, ty, tcy, tx, tcx, row, ka, kb);
+        } },
+                      threads > 0 ? (double)threads : -1.);
+}
+
+json PreProcessing::run(ImageBuffer &img, cv::Mat &dst)
+{
+    // Fold every step into one geometry (content rect on the output canvas) and one per-channel affine,
+    // then sample the source straight into the NCHW blob. Metadata matches run(cv::Mat &, cv::Mat &).
+    json metadata;
+    cv::Size canvas(img.width, img.height);
+    cv::Rect content(0, 0, img.width, img.height);
+    cv::Scalar alpha = cv::Scalar::all(1.0), beta = cv::Scalar::all(0.0), padColor = cv::Scalar::all(0.0);
+
+    for (auto &step : prepSteps)
+        for (auto &[name, kwargs] : step.items())
+        {
+            if (name == "DetRescale" || name == "DetLongMaxRescale")
+            {
+                cv::Size resized = outShape;
+                if (name == "DetRescale")
+                {
+                    float scaleFactor_h = (float)outShape.height / (float)canvas.height,
+                          scaleFactor_w = (float)outShape.width / (float)canvas.width;
+                    metadata.push_back({{"scale_factors", {scaleFactor_w, scaleFactor_h}}});
+                }
+                else
+                {
+                    float scaleFactor = std::min((float)(outShape.height - 4) / (float)canvas.height,
+                                                 (float)(outShape.width - 4) / (float)canvas.width);
+                    if (scaleFactor != 1.0f)
+                        resized = cv::Size((int)std::round((float)canvas.width * scaleFactor),
+                                           (int)std::round((float)canvas.height * scaleFactor));
+                    else
+                        resized = canvas;
+                    metadata.push_back({{"scale_factors", {scaleFactor, scaleFactor}}});
+                }
+
+                double sx = (double)resized.width / canvas.width,
+                       sy = (double)resized.height / canvas.height;
+                content = cv::Rect((int)std::round(content.x * sx), (int)std::round(content.y * sy),
+                                   (int)std::round(content.width * sx), (int)std::round(content.height * sy));
+                canvas = resized;
+            }
+            else if (name == "BotRightPad" || name == "CenterPad")
+            {
+                int padHeight = outShape.height - canvas.height,
+                    padWidth = outShape.width - canvas.width;
+                int padTop = name == "CenterPad" ? padHeight / 2 : 0,
+                    padLeft = name == "CenterPad" ? padWidth / 2 : 0;
+                int pad_value;
+                EXTRACT(pad_value, kwargs);
+
+                content.x += padLeft;
+                content.y += padTop;
+                canvas = outShape;
+                padColor = cv::Scalar::all(pad_value);
+                metadata.push_back({{"padding", {padTop, padHeight - padTop, padLeft, padWidth - padLeft}}});
+            }
+            else if (name == "Standardize" || name == "Normalize")
+            {
+                cv::Scalar a, b;
+                if (name == "Standardize")
+                {
+                    double max_value;
+                    EXTRACT(max_value, kwargs);
+                    a = cv::Scalar::all(1 / max_value);
+                    b = cv::Scalar::all(0.0);
+                }
+                else
+                {
+                    std::vector<double> mean, std;
+                    EXTRACT(mean, kwargs);
+                    EXTRACT(std, kwargs);
+                    a = cv::Scalar(1 / std[0], 1 / std[1], 1 / std[2]);
+                    b = cv::Scalar(-mean[0] / std[0], -mean[1] / std[1], -mean[2] / std[2]);
+                }
+
+                for (int c = 0; c < 3; c++)
+                {
+                    alpha[c] *= a[c];
+                    beta[c] = beta[c] * a[c] + b[c];
+                    padColor[c] = padColor[c] * a[c] + b[c];
+                }
+                metadata.push_back(nullptr);
+            }
+            else
+            {
+                std::cerr << LogError("Not Implemented", name + " in preprocessing steps isn't implemented yet!");
+                std::abort();
+            }
+        }
+
+    if (content.x < 0 || content.y < 0 || content.width <= 0 || content.height <= 0 ||
+        content.x + content.width > canvas.width || content.y + content.height > canvas.height)
+    {
+        std::cerr << LogError("Preprocessing", "Image doesn't fit into model input shape!") << std::endl;
+        std::abort();
+    }
+
+    int blobShape[4] = {1, 3, canvas.height, canvas.width};
+    dst.create(4, blobShape, blobDepth);
+
+    // Steps above are applied on BGR (as cv::imread)
+    const float ka[3] = {(float)alpha[2], (float)alpha[1], (float)alpha[0]},
+                kb[3] = {(float)beta[2], (float)beta[1], (float)beta[0]},
+                fill[3] = {(float)padColor[2], (float)padColor[1], (float)padColor[0]};
+    if (blobDepth == CV_8U)
+        fillBlob<uchar>(img, dst, content, swapRB, ka, kb, fill, threads);
+    else
+        fillBlob<float>(img, dst, content, swapRB, ka, kb, fill, threads);
 
     return metadata;
 }
@@ -147,6 +439,31 @@ PostProcessing::PostProcessing(json &steps, float score, float iou)
     iouThresh = iou;
 }
 
+void PostProcessing::setClassFilter(std::vector<int> ids, std::vector<float> thresholds)
+{
+    if (ids.size() != thresholds.size())
+    {
+        std::cerr << LogError("Classes", "Every active class needs a score threshold!") << std::endl;
+        std::abort();
+    }
+
+    std::vector<size_t> order(ids.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+              { return ids[a] < ids[b]; });
+
+    classes.clear();
+    classThresh.clear();
+    for (auto &i : order)
+    {
+        if (!classes.empty() && classes.back() == ids[i])
+            continue;
+        classes.push_back(ids[i]);
+        classThresh.push_back(thresholds[i]);
+    }
+}
+
 void PostProcessing::rescaleBox(std::vector<float> &box, json &metadata)
 {
     std::vector<float> scale_factors;
@@ -195,26 +512,45 @@ void PostProcessing::run(std::vector<std::vector<cv::Mat>> &outputs,
                          std::vector<int> &selectedIDX,
                          json &metadata)
 {
+    auto decodeStart = std::chrono::steady_clock::now();
     cv::Mat &rawScores = outputs[0][0],
             &bboxes = outputs[1][0];
     rawScores = rawScores.reshape(0, {rawScores.size[1], rawScores.size[2]});
     bboxes = bboxes.reshape(0, {bboxes.size[1], bboxes.size[2]});
 
-    cv::Mat rowScores;
-    for (int i = 0; i < bboxes.size[0]; i++)
+    const int numClasses = rawScores.size[1];
+    if (!classes.empty() && classes.back() >= numClasses)
     {
-        rowScores = rawScores.row(i);
-        cv::Point classID;
-        double maxScore;
-        minMaxLoc(rowScores, 0, &maxScore, 0, &classID);
+        std::cerr << LogError("Classes", "Class " + std::to_string(classes.back()) + " is out of the model range!") << std::endl;
+        std::abort();
+    }
 
-        if ((float)maxScore < scoreThresh)
-            continue;
+    for (int i = 0; i < bboxes.size[0]; i++)
+    {
+        const float *row = rawScores.ptr<float>(i);
+        int classID = -1;
+        float maxScore = 0.0f;
+        if (classes.empty())
+        {
+            classID = (int)(std::max_element(row, row + numClasses) - row);
+            maxScore = row[classID];
+            if (maxScore < scoreThresh)
+                continue;
+        }
+        else // argmax over the active classes only, then that class's own threshold
+        {
+            size_t best = 0;
+            for (size_t k = 1; k < classes.size(); k++)
+                if (row[classes[k]] > row[classes[best]])
+                    best = k;
+            classID = classes[best];
+            maxScore = row[classID];
+            if (maxScore < classThresh[best])
+                continue;
+        }
 
-        std::vector<float> box{bboxes.at<float>(i, 0),  // x
-                               bboxes.at<float>(i, 1),  // y
-                               bboxes.at<float>(i, 2),  // x1
-                               bboxes.at<float>(i, 3)}; // y1
+        const float *b = bboxes.ptr<float>(i);
+        std::vector<float> box{b[0], b[1], b[2], b[3]}; // x, y, x1, y1
 
         size_t idx = prepSteps.size();
         for (json::reverse_iterator step = prepSteps.rbegin(); step != prepSteps.rend(); ++step)
@@ -224,13 +560,18 @@ void PostProcessing::run(std::vector<std::vector<cv::Mat>> &outputs,
                 _call_fn(e.key(), box, metadata[idx]);
         }
 
-        labels.push_back(classID.x);
-        scores.push_back((float)maxScore);
+        labels.push_back(classID);
+        scores.push_back(maxScore);
         boxes.push_back(cv::Rect((int)box[0], (int)box[1], (int)(box[2] - box[0]), (int)(box[3] - box[1])));
     }
-    cv::dnn::NMSBoxes(boxes, scores, scoreThresh, iouThresh, selectedIDX);
+    metrics().stages[STAGE_POSTPROCESS].observe(std::chrono::steady_clock::now() - decodeStart);
+
+    float nmsThresh = classes.empty() ? scoreThresh : *std::min_element(classThresh.begin(), classThresh.end());
+    {
+        StageTimer timer(STAGE_NMS);
+        cv::dnn::NMSBoxes(boxes, scores, nmsThresh, iouThresh, selectedIDX);
+    }
 
     bboxes.release();
     rawScores.release();
-    rowScores.release();
 }
\ No newline at end of file
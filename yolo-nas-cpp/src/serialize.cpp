@@ -0,0 +1,36 @@
+#include "serialize.hpp"
+
+static_assert(sizeof(DetectionRecord) == 24, "DetectionRecord must stay 24 bytes");
+static_assert(sizeof(FrameHeader) == 16, "FrameHeader must stay 16 bytes");
+
+DetectionRecord toRecord(const Detection &det)
+{
+    return {det.box.x, det.box.y, det.box.width, det.box.height, det.classID, det.score};
+}
+
+Detection fromRecord(const DetectionRecord &record)
+{
+    return {cv::Rect(record.x, record.y, record.width, record.height), record.classID, record.score};
+}
+
+json detectionsToJson(const std::vector<Detection> &detections, const std::vector<std::string> &labels)
+{
+    json out = json::array();
+    for (auto &det : detections)
+        out.push_back({{"box", {det.box.x, det.box.y, det.box.width, det.box.height}},
+                       {"class_id", det.classID},
+                       {"label", det.classID < (int)labels.size() ? labels[det.classID] : std::to_string(det.classID)},
+                       {"score", det.score}});
+    return out;
+}
+
+void writeBinaryFrame(std::ostream &out, uint64_t frame, const std::vector<Detection> &detections)
+{
+    FrameHeader header{frame, (uint32_t)detections.size(), 0};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (auto &det : detections)
+    {
+        DetectionRecord record = toRecord(det);
+        out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    }
+}
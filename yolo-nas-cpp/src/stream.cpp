@@ -0,0 +1,119 @@
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#include "stream.hpp"
+#include "metrics.hpp"
+#include "utils.hpp"
+
+size_t frameBytes(PixelFormat format, int width, int height)
+{
+    size_t pixels = (size_t)width * (size_t)height;
+    if (format == FMT_NV12 || format == FMT_I420)
+        return pixels + 2 * ((size_t)((width + 1) / 2) * (size_t)((height + 1) / 2));
+    return pixels * 3;
+}
+
+RawFrameReader::RawFrameReader(std::string path, size_t bytes, int numSlots)
+{
+    ownsFile = path != "-";
+    file = ownsFile ? std::fopen(path.c_str(), "rb") : stdin;
+#ifdef _WIN32
+    if (!ownsFile)
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    if (file == nullptr)
+    {
+        std::cerr << LogError("Raw Stream", "Can't open " + path) << std::endl;
+        std::abort();
+    }
+    // frames are read straight into the slots, stdio buffering would only add a copy
+    std::setvbuf(file, nullptr, _IONBF, 0);
+
+    frameSize = bytes;
+    slots.assign(std::max(numSlots, 1), std::vector<uchar>(frameSize));
+    depth = &metrics().queue("raw_stream");
+    reader = std::thread(&RawFrameReader::readLoop, this);
+}
+
+RawFrameReader::~RawFrameReader()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopped = true;
+    }
+    changed.notify_all();
+    // a reader blocked in fread on a pipe returns once the writer sends a frame or closes
+    reader.join();
+    if (ownsFile)
+        std::fclose(file);
+}
+
+void RawFrameReader::readLoop()
+{
+    size_t tail = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            changed.wait(guard, [&]
+                         { return stopped || filled < slots.size(); });
+            if (stopped)
+                break;
+        }
+
+        // the slot is owned by the reader until it is published, no lock needed while reading
+        size_t got = std::fread(slots[tail].data(), 1, frameSize, file);
+        if (got != frameSize)
+        {
+            if (got > 0)
+            {
+                std::cerr << LogWarning("Raw Stream", "Dropping truncated frame (" + std::to_string(got) + "/" +
+                                                          std::to_string(frameSize) + " bytes)")
+                          << std::endl;
+                metrics().frameDropped();
+            }
+            else if (std::ferror(file))
+                std::cerr << LogWarning("Raw Stream", "Read error, stopping stream") << std::endl;
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            filled++;
+            depth->fetch_add(1);
+        }
+        changed.notify_all();
+        tail = (tail + 1) % slots.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        finished = true;
+    }
+    changed.notify_all();
+}
+
+const uchar *RawFrameReader::next()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    changed.wait(guard, [&]
+                 { return filled > 0 || finished; });
+    if (filled == 0)
+        return nullptr;
+    return slots[head].data();
+}
+
+void RawFrameReader::release()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (filled == 0)
+            return;
+        filled--;
+        depth->fetch_sub(1);
+        head = (head + 1) % slots.size();
+    }
+    changed.notify_all();
+}
@@ -0,0 +1,114 @@
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "threading.hpp"
+#include "utils.hpp"
+
+std::vector<int> parseCPUList(std::string list)
+{
+    // linux cpulist format, e.g. "0-3,8,10-11"
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+        if (range.empty())
+            continue;
+
+        size_t dash = range.find('-');
+        std::string first = range.substr(0, dash),
+                    last = dash == std::string::npos ? first : range.substr(dash + 1);
+        if (!isNumber(first) || !isNumber(last))
+        {
+            std::cerr << LogError("CPU List", "Invalid cpu list '" + list + "'") << std::endl;
+            std::abort();
+        }
+
+        for (int cpu = std::stoi(first); cpu <= std::stoi(last); cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<int> numaNodeCPUs(int node)
+{
+    std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+    std::ifstream f(path);
+    std::string list;
+    if (!f || !std::getline(f, list))
+    {
+        std::cerr << LogError("NUMA", "Can't read cpus of node " + std::to_string(node) + " from " + path) << std::endl;
+        std::abort();
+    }
+    return parseCPUList(list);
+}
+
+bool pinThread(const std::vector<int> &cpus)
+{
+    if (cpus.empty())
+        return true;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto &cpu : cpus)
+        CPU_SET(cpu, &set);
+
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+    {
+        std::cerr << LogWarning("CPU Affinity", "Failed to pin thread to cpus " + describeCPUs(cpus)) << std::endl;
+        return false;
+    }
+    return true;
+#else
+    std::cerr << LogWarning("CPU Affinity", "Thread pinning is only supported on linux, ignoring.") << std::endl;
+    return false;
+#endif
+}
+
+void applyThreading(Threading &threading, int replicas)
+{
+    // OpenCV pool is process wide. Its workers are spawned lazily and inherit the affinity of the
+    // thread that first runs a parallel region, so pin before building the net.
+    // With several pinned replicas the pool would follow whichever replica gets there first (and other
+    // replicas fall back to serial regions while it is busy), so each replica runs single threaded on its cpus.
+    if (replicas > 1 && threading.cpus.size() > 1)
+    {
+        if (threading.inference != 1)
+            std::cerr << LogWarning("Threads", "OpenCV thread pool is shared by all replicas and can't follow per replica "
+                                               "cpu sets, forcing --threads-inference 1 (use --workers to scale)")
+                      << std::endl;
+        threading.inference = 1;
+    }
+
+    if (threading.inference > 0)
+        cv::setNumThreads(threading.inference);
+}
+
+std::string describeCPUs(const std::vector<int> &cpus)
+{
+    std::string out;
+    for (size_t i = 0; i < cpus.size(); i++)
+    {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            j++;
+
+        if (!out.empty())
+            out += ",";
+        out += std::to_string(cpus[i]);
+        if (j > i)
+            out += "-" + std::to_string(cpus[j]);
+        i = j;
+    }
+    return out;
+}
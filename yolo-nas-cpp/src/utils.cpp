@@ -1,6 +1,10 @@
 #include <iostream>
 #include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <iterator>
 
+#include "metrics.hpp"
 #include "utils.hpp"
 
 std::string LogInfo(std::string header, std::string body)
@@ -36,6 +40,27 @@ bool isNumber(const std::string &s)
     return !s.empty() && it == s.end();
 }
 
+std::vector<std::string> listImages(std::string dir)
+{
+    const std::vector<std::string> extensions{".jpg", ".jpeg", ".png", ".bmp", ".webp", ".tif", ".tiff"};
+    std::vector<std::string> images;
+    for (auto &entry : std::filesystem::directory_iterator(dir))
+    {
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (entry.is_regular_file() && std::find(extensions.begin(), extensions.end(), ext) != extensions.end())
+            images.push_back(entry.path().string());
+    }
+    std::sort(images.begin(), images.end());
+    return images;
+}
+
+std::vector<uchar> readBytes(std::string path)
+{
+    std::ifstream f(path, std::ios::binary);
+    return std::vector<uchar>((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+}
+
 VideoExporter::VideoExporter(cv::VideoCapture &cap, std::string path)
 {
     exportPath = path;
@@ -61,7 +86,10 @@ VideoExporter::VideoExporter(cv::VideoCapture &cap, std::string path)
 void VideoExporter::write(cv::Mat &frame)
 {
     if (exportPath != "")
+    {
+        StageTimer timer(STAGE_ENCODE);
         writer.write(frame);
+    }
 }
 
 void VideoExporter::close()
@@ -1,12 +1,16 @@
+#include <algorithm>
+#include <atomic>
+
+#include "metrics.hpp"
 #include "utils.hpp"
 #include "yolo-nas.hpp"
 
-YoloNAS::YoloNAS(std::string netPath, bool cuda, json &prepSteps, std::vector<int> imgsz, float score, float iou, std::vector<std::string> &labels)
+YoloNAS::YoloNAS(std::string netPath, bool cuda, json &prepSteps, std::vector<int> imgsz, float score, float iou, std::vector<std::string> &labels, bool swapRB)
 {
     net = cv::dnn::readNetFromONNX(netPath);
     if (cuda && cv::cuda::getCudaEnabledDeviceCount() > 0)
     {
-        std::cout << LogInfo("Backend", "Attempting to use CUDA") << std::endl;
+        std::cerr << LogInfo("Backend", "Attempting to use CUDA") << std::endl;
         net.setPreferableBackend(cv::dnn::DNN_BACKEND_CUDA);
         net.setPreferableTarget(cv::dnn::DNN_TARGET_CUDA);
     }
@@ -22,8 +26,9 @@ YoloNAS::YoloNAS(std::string netPath, bool cuda, json &prepSteps, std::vector<in
     scoreThresh = score;
     iouThresh = iou;
     classLabels = labels;
+    metrics().setLabels(classLabels);
 
-    preprocess = PreProcessing(prepSteps, imgsz);
+    preprocess = PreProcessing(prepSteps, imgsz, swapRB);
     postprocess = PostProcessing(prepSteps, score, iou);
 
     warmup(3);
@@ -31,29 +36,27 @@ YoloNAS::YoloNAS(std::string netPath, bool cuda, json &prepSteps, std::vector<in
 
 void YoloNAS::warmup(int round)
 {
-    cv::Mat mat(4, netInputShape, CV_32F);
+    inputBlob.create(4, netInputShape, CV_32F);
     std::vector<std::vector<cv::Mat>> out;
     for (int i = 0; i < round; i++)
     {
-        randu(mat, cv::Scalar(0), cv::Scalar(1));
-        net.setInput(mat);
+        randu(inputBlob, cv::Scalar(0), cv::Scalar(1));
+        net.setInput(inputBlob);
         net.forward(out, net.getUnconnectedOutLayersNames());
     }
 
-    mat.release();
     out[0][0].release();
     out[1][0].release();
 }
 
-void YoloNAS::predict(cv::Mat &img)
+std::vector<Detection> YoloNAS::infer(cv::Mat &blob, json &metadata)
 {
-    cv::Mat imgInput;
-    json metadata = preprocess.run(img, imgInput);
-
     std::vector<std::vector<cv::Mat>> out;
-    net.setInput(imgInput);
-    net.forward(out, net.getUnconnectedOutLayersNames());
-    imgInput.release();
+    {
+        StageTimer timer(STAGE_FORWARD);
+        net.setInput(blob);
+        net.forward(out, net.getUnconnectedOutLayersNames());
+    }
 
     std::vector<float> scores;
     std::vector<cv::Rect> boxes;
@@ -61,12 +64,111 @@ void YoloNAS::predict(cv::Mat &img)
 
     postprocess.run(out, boxes, labels, scores, selectedIDX, metadata);
 
+    std::vector<Detection> detections;
     for (auto &x : selectedIDX)
     {
-        int classID = labels[x];
-        float score = scores[x];
-        cv::Scalar color = colors.get(classID);
-        cv::rectangle(img, boxes[x], color, 2);
-        draw_box(img, boxes[x], classLabels[classID], score, color);
+        detections.push_back({boxes[x], labels[x], scores[x]});
+        metrics().countDetection(labels[x]);
+    }
+    metrics().frameProcessed();
+    return detections;
+}
+
+std::vector<Detection> YoloNAS::detect(cv::Mat &img)
+{
+    // Mat preprocessing runs on the shared OpenCV pool, only the fused path honours the preprocess budget
+    if (preprocess.threads > 0)
+    {
+        if (img.type() == CV_8UC3)
+        {
+            ImageBuffer buffer(img.data, img.cols, img.rows, FMT_BGR, img.step[0]);
+            return detect(buffer);
+        }
+        static std::atomic<bool> warned{false};
+        if (!warned.exchange(true))
+            std::cerr << LogWarning("Threads", "--threads-preprocess only applies to 8 bit BGR images, ignoring.") << std::endl;
+    }
+
+    json metadata;
+    {
+        StageTimer timer(STAGE_PREPROCESS);
+        metadata = preprocess.run(img, inputBlob);
+    }
+    return infer(inputBlob, metadata);
+}
+
+std::vector<Detection> YoloNAS::detect(ImageBuffer &img)
+{
+    json metadata;
+    {
+        StageTimer timer(STAGE_PREPROCESS);
+        metadata = preprocess.run(img, inputBlob);
+    }
+    return infer(inputBlob, metadata);
+}
+
+void YoloNAS::predict(cv::Mat &img)
+{
+    std::vector<Detection> detections = detect(img);
+    draw(img, detections);
+}
+
+// classes are given by label name or index, thresholds default to the global score threshold
+void YoloNAS::filterClasses(std::vector<std::string> &classes, std::map<std::string, float> &thresholds)
+{
+    if (classes.empty() && thresholds.empty())
+        return;
+
+    auto classIndex = [&](const std::string &name)
+    {
+        auto it = std::find(classLabels.begin(), classLabels.end(), name);
+        if (it != classLabels.end())
+            return (int)(it - classLabels.begin());
+        if (isNumber(name) && std::stoul(name) < classLabels.size())
+            return std::stoi(name);
+        std::cerr << LogError("Classes", "Unknown class " + name) << std::endl;
+        std::abort();
+    };
+
+    std::vector<float> perClass(classLabels.size(), scoreThresh);
+    for (auto &e : thresholds)
+        perClass[classIndex(e.first)] = e.second;
+
+    std::vector<int> ids;
+    if (classes.empty())
+        for (int i = 0; i < (int)classLabels.size(); i++)
+            ids.push_back(i);
+    for (auto &name : classes)
+        ids.push_back(classIndex(name));
+
+    std::vector<float> idsThresh;
+    for (auto &id : ids)
+        idsThresh.push_back(perClass[id]);
+    postprocess.setClassFilter(ids, idsThresh);
+}
+
+json YoloNAS::describe()
+{
+    json description{{"prep_steps", preprocess.prepSteps},
+                     {"input_shape", {preprocess.outShape.width, preprocess.outShape.height}},
+                     {"swap_rb", preprocess.swapRB},
+                     {"score_thresh", postprocess.scoreThresh},
+                     {"iou_thresh", postprocess.iouThresh}};
+    if (!postprocess.classes.empty())
+    {
+        description["classes"] = postprocess.classes;
+        description["class_thresh"] = postprocess.classThresh;
+    }
+    return description;
+}
+
+void YoloNAS::draw(cv::Mat &img, std::vector<Detection> &detections)
+{
+    StageTimer timer(STAGE_DRAW);
+    for (auto &det : detections)
+    {
+        cv::Scalar color = colors.get(det.classID);
+        cv::rectangle(img, det.box, color, 2);
+        draw_box(img, det.box, classLabels[det.classID], det.score, color);
     }
 }
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include <argparse/argparse.hpp>
+#include <chrono>
+#include <fstream>
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+
+#include "utils.hpp"
+#include "cli.hpp"
+#include "pool.hpp"
+#include "evaluation.hpp"
+#include "yolo-nas.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+void printStage(std::string name, json stats)
+{
+    std::cout << std::left << std::setw(14) << name << std::fixed << std::setprecision(3)
+              << std::setw(10) << stats["mean"].get<double>() << std::setw(10) << stats["p50"].get<double>()
+              << std::setw(10) << stats["p90"].get<double>() << std::setw(10) << stats["p99"].get<double>()
+              << stats["max"].get<double>() << std::defaultfloat << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("yolo-nas-bench");
+    program.add_description("Benchmark YOLO-NAS model stages");
+
+    program.add_argument("model").help("Path to the YOLO-NAS ONNX model.").metavar("MODEL");
+    program.add_argument("-I", "--image").help("Path to the image source [default: random 1280x720 image]").metavar("IMAGE");
+    program.add_argument("--imgsz")
+        .help("Model input size [default: {640 640}]")
+        .nargs(1, 2)
+        .scan<'i', int>();
+    program.add_argument("--iterations")
+        .default_value(100)
+        .help("Number of frames processed by each replica")
+        .scan<'i', int>();
+    program.add_argument("--workers")
+        .default_value(1)
+        .help("Number of model replicas running in parallel")
+        .scan<'i', int>();
+    program.add_argument("--buffer")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Feed the image as a raw BGR buffer (fused preprocessing)");
+    program.add_argument("--score-thresh")
+        .help("Score threshold, lower it to emulate crowded frames [default: 0.25]")
+        .scan<'g', float>();
+    program.add_argument("--gpu")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Use GPU if available");
+    program.add_argument("--custom-metadata")
+        .help("Path to metadata file (Generated from https://gist.github.com/Hyuto/f3db1c0c2c36308284e101f441c2555f)");
+    program.add_argument("--report").help("Export json report to a file");
+    addClassArgs(program);
+    addThreadingArgs(program);
+
+    try
+    {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err)
+    {
+        std::cerr << LogError("Parser Error", err.what()) << std::endl;
+        std::cerr << program;
+        std::abort();
+    }
+
+    Threading threading = parseThreadingArgs(program);
+    applyThreading(threading, program.get<int>("--workers"));
+
+    Net net;
+    net.path = program.get<std::string>("model");
+    net.gpu = program.get<bool>("--gpu");
+    exists(net.path);
+
+    Processing processing;
+    auto customMetadataArgs = program.present<std::string>("--custom-metadata");
+    if (customMetadataArgs)
+        parseMetadata(customMetadataArgs.value(), net, processing);
+    parseClassArgs(program, processing);
+    if (net.labels.size() == 0)
+        net.labels = COCO_LABELS;
+    auto imgSizeArgs = program.present<std::vector<int>>("--imgsz");
+    if (imgSizeArgs)
+        processing.inputShape = {imgSizeArgs.value()[0], imgSizeArgs.value().back()};
+    else if (processing.inputShape.size() == 0)
+        processing.inputShape = {640, 640};
+    auto scoreThreshArgs = program.present<float>("--score-thresh");
+    if (scoreThreshArgs)
+        processing.scoreThresh = scoreThreshArgs.value();
+    else if (processing.scoreThresh == -1.0f)
+        processing.scoreThresh = 0.25f;
+    if (processing.iouThresh == -1.0f)
+        processing.iouThresh = 0.45f;
+
+    cv::Mat img;
+    auto imgPathArgs = program.present<std::string>("-I");
+    if (imgPathArgs)
+    {
+        exists(imgPathArgs.value());
+        img = cv::imread(imgPathArgs.value());
+    }
+    else
+    {
+        img = cv::Mat(720, 1280, CV_8UC3);
+        cv::randu(img, cv::Scalar::all(0), cv::Scalar::all(255));
+    }
+    ImageBuffer buffer(img.data, img.cols, img.rows, FMT_BGR, img.step[0]);
+
+    bool useBuffer = program.get<bool>("--buffer");
+    int iterations = program.get<int>("--iterations");
+    WorkerPool pool(program.get<int>("--workers"), threading.cpus);
+
+    std::cout << LogInfo("Benchmark", "model=" + net.path) << " source=" << (imgPathArgs ? imgPathArgs.value() : "random")
+              << " imgsz=[" << processing.inputShape[0] << "," << processing.inputShape[1] << "]"
+              << " input=" << (useBuffer ? "buffer" : "mat") << " workers=" << pool.workers
+              << " iterations=" << iterations << " opencv-threads=" << cv::getNumThreads();
+    for (int i = 0; i < (int)threading.cpus.size() && i < pool.workers; i++)
+        std::cout << " cpus[" << i << "]=" << describeCPUs(threading.cpus[i]);
+    std::cout << std::endl;
+
+    std::vector<std::unique_ptr<YoloNAS>> replicas(pool.workers);
+    pool.run(0, [&](int id)
+             {
+        replicas[id] = std::make_unique<YoloNAS>(net.path, net.gpu, processing.PrepSteps, processing.inputShape,
+                                                 processing.scoreThresh, processing.iouThresh, net.labels, processing.swapRB);
+        replicas[id]->preprocess.threads = threading.preprocess;
+        replicas[id]->filterClasses(processing.classes, processing.classThresh); });
+
+    LatencyStats preprocessStats, forwardStats, postprocessStats, totalStats;
+    std::atomic<size_t> detections{0}, candidates{0};
+    auto start = Clock::now();
+    pool.run((size_t)iterations * pool.workers, [&](int id)
+             {
+        YoloNAS &model = *replicas[id];
+        cv::Mat blob;
+        std::vector<std::vector<cv::Mat>> out;
+        size_t item;
+        while (pool.next(item))
+        {
+            auto t0 = Clock::now();
+            json metadata = useBuffer ? model.preprocess.run(buffer, blob) : model.preprocess.run(img, blob);
+            auto t1 = Clock::now();
+            model.net.setInput(blob);
+            model.net.forward(out, model.net.getUnconnectedOutLayersNames());
+            auto t2 = Clock::now();
+
+            std::vector<float> scores;
+            std::vector<cv::Rect> boxes;
+            std::vector<int> labels, selectedIDX;
+            model.postprocess.run(out, boxes, labels, scores, selectedIDX, metadata);
+            auto t3 = Clock::now();
+
+            preprocessStats.add(elapsedMs(t0, t1));
+            forwardStats.add(elapsedMs(t1, t2));
+            postprocessStats.add(elapsedMs(t2, t3));
+            totalStats.add(elapsedMs(t0, t3));
+            detections += selectedIDX.size();
+            candidates += boxes.size();
+        } });
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    double throughput = (double)totalStats.count() / seconds;
+
+    // with a class filter the same outputs are decoded with and without the filter, outside of the throughput window
+    std::vector<int> &activeClasses = replicas[0]->postprocess.classes;
+    bool compareClasses = !activeClasses.empty();
+    LatencyStats subsetStats, allClassesStats;
+    std::atomic<size_t> subsetCandidates{0}, allClassesCandidates{0};
+    if (compareClasses)
+        pool.run((size_t)iterations * pool.workers, [&](int id)
+                 {
+            YoloNAS &model = *replicas[id];
+            PostProcessing allClasses = model.postprocess;
+            allClasses.setClassFilter({}, {});
+            cv::Mat blob;
+            std::vector<std::vector<cv::Mat>> out;
+            json metadata = useBuffer ? model.preprocess.run(buffer, blob) : model.preprocess.run(img, blob);
+            model.net.setInput(blob);
+            model.net.forward(out, model.net.getUnconnectedOutLayersNames());
+
+            size_t item;
+            while (pool.next(item))
+            {
+                // postprocess reshapes and releases its own headers, data is shared
+                std::vector<std::vector<cv::Mat>> subsetOut = out, allOut = out;
+                std::vector<float> scores;
+                std::vector<cv::Rect> boxes;
+                std::vector<int> labels, selectedIDX;
+                auto t0 = Clock::now();
+                model.postprocess.run(subsetOut, boxes, labels, scores, selectedIDX, metadata);
+                auto t1 = Clock::now();
+                subsetStats.add(elapsedMs(t0, t1));
+                subsetCandidates += boxes.size();
+
+                scores.clear();
+                boxes.clear();
+                labels.clear();
+                selectedIDX.clear();
+                auto t2 = Clock::now();
+                allClasses.run(allOut, boxes, labels, scores, selectedIDX, metadata);
+                allClassesStats.add(elapsedMs(t2, Clock::now()));
+                allClassesCandidates += boxes.size();
+            } });
+
+    std::cout << std::left << std::setw(14) << "stage (ms)" << std::setw(10) << "mean" << std::setw(10) << "p50"
+              << std::setw(10) << "p90" << std::setw(10) << "p99" << "max" << std::endl;
+    printStage("preprocess", preprocessStats.summarize());
+    printStage("forward", forwardStats.summarize());
+    printStage("postprocess", postprocessStats.summarize());
+    printStage("total", totalStats.summarize());
+    std::cout << LogInfo("Throughput", std::to_string(throughput) + " frames/s") << " detections/frame="
+              << (double)detections / (double)totalStats.count() << " nms-candidates/frame="
+              << (double)candidates / (double)totalStats.count() << std::endl;
+
+    json classFilterReport;
+    if (compareClasses)
+    {
+        json subset = subsetStats.summarize(), all = allClassesStats.summarize();
+        double speedup = all["mean"].get<double>() / std::max(subset["mean"].get<double>(), 1e-9);
+        double frames = (double)allClassesStats.count();
+        printStage("postprocess+", subset);
+        printStage("postprocess*", all);
+        std::cout << LogInfo("Class Filter", "classes=" + std::to_string(activeClasses.size()) + "/" + std::to_string(net.labels.size()))
+                  << " nms-candidates/frame=" << (double)allClassesCandidates / frames
+                  << "->" << (double)subsetCandidates / frames
+                  << " postprocess-speedup=" << speedup << "x (+ class filter, * all classes)" << std::endl;
+        classFilterReport = {{"classes", activeClasses},
+                             {"nms_candidates_per_frame", (double)subsetCandidates / frames},
+                             {"all_classes_nms_candidates_per_frame", (double)allClassesCandidates / frames},
+                             {"postprocess_ms", subset},
+                             {"all_classes_postprocess_ms", all},
+                             {"postprocess_speedup", speedup}};
+    }
+
+    auto reportArgs = program.present<std::string>("--report");
+    if (reportArgs)
+    {
+        json report{{"model", net.path},
+                    {"imgsz", processing.inputShape},
+                    {"input", useBuffer ? "buffer" : "mat"},
+                    {"workers", pool.workers},
+                    {"threads", {{"inference", threading.inference}, {"preprocess", threading.preprocess}, {"opencv", cv::getNumThreads()}}},
+                    {"score_thresh", processing.scoreThresh},
+                    {"throughput", throughput},
+                    {"latency_ms", {{"preprocess", preprocessStats.summarize()}, {"forward", forwardStats.summarize()}, {"postprocess", postprocessStats.summarize()}, {"total", totalStats.summarize()}}}};
+        if (compareClasses)
+            report["class_filter"] = classFilterReport;
+        std::ofstream f(reportArgs.value());
+        f << report.dump(2) << std::endl;
+        std::cout << LogInfo("Export Report", reportArgs.value()) << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,255 @@
+#include <argparse/argparse.hpp>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+#include "utils.hpp"
+#include "cli.hpp"
+#include "pool.hpp"
+#include "evaluation.hpp"
+#include "metrics.hpp"
+#include "yolo-nas.hpp"
+
+struct EvalRun
+{
+    std::vector<int> imgsz;
+    float scoreThresh;
+    float iouThresh;
+    json result;
+};
+
+json evaluate(Net &net, Processing &processing, Threading &threading, CocoDataset &dataset, int workers)
+{
+    CocoEvaluator evaluator(dataset, (int)net.labels.size());
+    LatencyStats latency;
+    WorkerPool pool(workers, threading.cpus);
+
+    // every worker owns a replica, cv::dnn::Net isn't thread safe
+    std::vector<std::unique_ptr<YoloNAS>> replicas(pool.workers);
+    pool.run(0, [&](int id)
+             {
+        replicas[id] = std::make_unique<YoloNAS>(net.path, net.gpu, processing.PrepSteps, processing.inputShape,
+                                                 processing.scoreThresh, processing.iouThresh, net.labels, processing.swapRB);
+        replicas[id]->preprocess.threads = threading.preprocess;
+        replicas[id]->filterClasses(processing.classes, processing.classThresh); });
+
+    auto start = std::chrono::steady_clock::now();
+    pool.run(dataset.images.size(), [&](int id)
+             {
+        YoloNAS &model = *replicas[id];
+        size_t item;
+        while (pool.next(item))
+        {
+            CocoImage &image = dataset.images[item];
+            cv::Mat img = cv::imread(image.path);
+            if (img.empty())
+            {
+                std::cerr << LogWarning("Evaluate", "Can't read " + image.path) << std::endl;
+                metrics().frameDropped();
+                continue;
+            }
+
+            auto t0 = std::chrono::steady_clock::now();
+            std::vector<Detection> detections = model.detect(img);
+            latency.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count());
+
+            evaluator.add(image.id, detections);
+        } });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    json result = evaluator.summarize(replicas[0]->postprocess.classes);
+    result["images"] = latency.count();
+    result["seconds"] = seconds;
+    result["throughput"] = seconds > 0 ? (double)latency.count() / seconds : 0.0;
+    result["latency_ms"] = latency.summarize();
+    return result;
+}
+
+void printTable(std::vector<EvalRun> &runs)
+{
+    std::cout << std::left << std::setw(12) << "imgsz" << std::setw(8) << "score" << std::setw(8) << "iou"
+              << std::setw(9) << "mAP" << std::setw(9) << "mAP50" << std::setw(10) << "img/s"
+              << std::setw(10) << "p50(ms)" << std::setw(10) << "p99(ms)" << "pareto" << std::endl;
+
+    std::cout << std::fixed;
+    for (auto &run : runs)
+    {
+        json &r = run.result;
+        std::string imgsz = std::to_string(run.imgsz[0]) + "x" + std::to_string(run.imgsz[1]);
+        std::cout << std::setw(12) << imgsz << std::setprecision(3)
+                  << std::setw(8) << run.scoreThresh << std::setw(8) << run.iouThresh
+                  << std::setw(9) << r["mAP"].get<double>() << std::setw(9) << r["mAP50"].get<double>()
+                  << std::setprecision(2) << std::setw(10) << r["throughput"].get<double>()
+                  << std::setw(10) << r["latency_ms"]["p50"].get<double>()
+                  << std::setw(10) << r["latency_ms"]["p99"].get<double>()
+                  << (r["pareto"].get<bool>() ? "*" : "") << std::endl;
+    }
+    std::cout << std::defaultfloat;
+}
+
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("yolo-nas-eval");
+    program.add_description("Evaluate YOLO-NAS model accuracy and speed on a COCO format dataset");
+
+    program.add_argument("model").help("Path to the YOLO-NAS ONNX model.").metavar("MODEL");
+    program.add_argument("--images").required().help("Path to the images directory").metavar("DIR");
+    program.add_argument("--annotations").required().help("Path to the COCO format annotation json").metavar("JSON");
+
+    program.add_argument("--imgsz")
+        .help("Model input size [default: {640 640}], list of square sizes on sweep mode")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .scan<'i', int>();
+    program.add_argument("--score-thresh")
+        .help("Score threshold [default: 0.25], list of thresholds on sweep mode")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .scan<'g', float>();
+    program.add_argument("--iou-thresh")
+        .help("NMS IOU threshold [default: 0.45], list of thresholds on sweep mode")
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .scan<'g', float>();
+    program.add_argument("--sweep")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Evaluate every combination of --imgsz, --score-thresh and --iou-thresh");
+    program.add_argument("--workers")
+        .default_value(1)
+        .help("Number of model replicas running in parallel")
+        .scan<'i', int>();
+    program.add_argument("--gpu")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Use GPU if available");
+    program.add_argument("--custom-metadata")
+        .help("Path to metadata file (Generated from https://gist.github.com/Hyuto/f3db1c0c2c36308284e101f441c2555f)");
+    program.add_argument("--report").help("Export json report to a file");
+    addClassArgs(program);
+    addThreadingArgs(program);
+
+    try
+    {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err)
+    {
+        std::cerr << LogError("Parser Error", err.what()) << std::endl;
+        std::cerr << program;
+        std::abort();
+    }
+
+    bool sweep = program.get<bool>("--sweep");
+    auto imgSizeArgs = program.present<std::vector<int>>("--imgsz");
+    auto scoreThreshArgs = program.present<std::vector<float>>("--score-thresh"),
+         iouThreshArgs = program.present<std::vector<float>>("--iou-thresh");
+    auto customMetadataArgs = program.present<std::string>("--custom-metadata"),
+         reportArgs = program.present<std::string>("--report");
+
+    Threading threading = parseThreadingArgs(program);
+    applyThreading(threading, program.get<int>("--workers"));
+
+    Net net;
+    net.path = program.get<std::string>("model");
+    net.gpu = program.get<bool>("--gpu");
+    exists(net.path);
+
+    Processing base;
+    if (customMetadataArgs)
+        parseMetadata(customMetadataArgs.value(), net, base);
+    parseClassArgs(program, base);
+    if (net.labels.size() == 0)
+        net.labels = COCO_LABELS;
+    if (base.inputShape.size() == 0)
+        base.inputShape = {640, 640};
+    if (base.scoreThresh == -1.0f)
+        base.scoreThresh = 0.25f;
+    if (base.iouThresh == -1.0f)
+        base.iouThresh = 0.45f;
+
+    std::vector<std::vector<int>> sizes{base.inputShape};
+    std::vector<float> scoreThreshs{base.scoreThresh}, iouThreshs{base.iouThresh};
+    if (imgSizeArgs)
+    {
+        std::vector<int> imgsz = imgSizeArgs.value();
+        sizes.clear();
+        if (sweep)
+            for (auto &s : imgsz)
+                sizes.push_back({s, s});
+        else if (imgsz.size() <= 2)
+            sizes.push_back({imgsz[0], imgsz.back()});
+        else
+        {
+            std::cerr << LogError("Input Size", "Pass one or two values to --imgsz, or use --sweep") << std::endl;
+            std::abort();
+        }
+    }
+    if (scoreThreshArgs)
+        scoreThreshs = scoreThreshArgs.value();
+    if (iouThreshArgs)
+        iouThreshs = iouThreshArgs.value();
+    if (!sweep && (scoreThreshs.size() > 1 || iouThreshs.size() > 1))
+    {
+        std::cerr << LogError("Thresholds", "Multiple thresholds are only allowed with --sweep") << std::endl;
+        std::abort();
+    }
+
+    CocoDataset dataset(program.get<std::string>("--images"), program.get<std::string>("--annotations"), net.labels);
+    int workers = program.get<int>("--workers");
+    std::cout << LogInfo("Evaluate", "model=" + net.path) << " images=" << dataset.images.size()
+              << " workers=" << workers << " runs=" << sizes.size() * scoreThreshs.size() * iouThreshs.size() << std::endl;
+
+    std::vector<EvalRun> runs;
+    for (auto &imgsz : sizes)
+        for (auto &score : scoreThreshs)
+            for (auto &iou : iouThreshs)
+            {
+                Processing processing = base;
+                processing.inputShape = imgsz;
+                processing.scoreThresh = score;
+                processing.iouThresh = iou;
+
+                EvalRun run{imgsz, score, iou, evaluate(net, processing, threading, dataset, workers)};
+                std::cout << LogInfo("Run", "imgsz=[" + std::to_string(imgsz[0]) + "," + std::to_string(imgsz[1]) + "]")
+                          << " score-thresh=" << score << " iou-thresh=" << iou
+                          << " mAP=" << run.result["mAP"] << " mAP50=" << run.result["mAP50"]
+                          << " img/s=" << run.result["throughput"] << std::endl;
+                runs.push_back(run);
+            }
+
+    // a run is on the pareto front if no other run is at least as accurate and as fast, and strictly better in one
+    for (auto &run : runs)
+    {
+        double mAP = run.result["mAP"].get<double>(), fps = run.result["throughput"].get<double>();
+        bool dominated = false;
+        for (auto &other : runs)
+        {
+            double otherMAP = other.result["mAP"].get<double>(), otherFPS = other.result["throughput"].get<double>();
+            if (otherMAP >= mAP && otherFPS >= fps && (otherMAP > mAP || otherFPS > fps))
+                dominated = true;
+        }
+        run.result["pareto"] = !dominated;
+    }
+
+    std::sort(runs.begin(), runs.end(), [](const EvalRun &a, const EvalRun &b)
+              { return a.result["throughput"].get<double>() > b.result["throughput"].get<double>(); });
+    printTable(runs);
+
+    if (reportArgs)
+    {
+        json report{{"model", net.path}, {"images", dataset.images.size()}, {"workers", workers}, {"runs", json::array()}};
+        for (auto &run : runs)
+        {
+            json entry = run.result;
+            entry["imgsz"] = run.imgsz;
+            entry["score_thresh"] = run.scoreThresh;
+            entry["iou_thresh"] = run.iouThresh;
+            report["runs"].push_back(entry);
+        }
+
+        std::ofstream f(reportArgs.value());
+        f << report.dump(2) << std::endl;
+        std::cout << LogInfo("Export Report", reportArgs.value()) << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,188 @@
+import argparse
+import json
+import os
+
+import numpy as np
+import onnx
+from onnx import helper, numpy_helper, TensorProto
+
+from yolo_nas.processing import YOLO_NAS_DEFAULT_PROCESSING_STEPS
+from yolo_nas.utils import log_info, log_warning, COCO_DEFAULT_LABELS
+
+AFFINE_STEPS = ("Standardize", "Normalize")
+
+
+def get_affine(steps):
+    """Collapse Standardize / Normalize steps into a per channel affine (x * alpha + beta)
+
+    Steps are applied on BGR images (before blobFromImage swaps to RGB), so alpha and beta are BGR ordered.
+
+    Args:
+        steps (List[Dict]): Preprocessing steps.
+
+    Returns:
+        Tuple[np.ndarray, np.ndarray, List[Dict]]: alpha, beta and the remaining (geometric) steps.
+    """
+    alpha, beta = np.ones(3, dtype=np.float64), np.zeros(3, dtype=np.float64)
+    remaining = []
+    for st in steps:
+        if not st:  # skip None step
+            continue
+        name, kwargs = list(st.items())[0]
+        if name == "Standardize":
+            a, b = np.full(3, 1 / kwargs["max_value"]), np.zeros(3)
+        elif name == "Normalize":
+            std, mean = np.asarray(kwargs["std"], dtype=np.float64), np.asarray(kwargs["mean"], dtype=np.float64)
+            a, b = 1 / std, -mean / std
+        else:
+            if np.any(alpha != 1) or np.any(beta != 0):
+                raise ValueError(f"{name} after {'/'.join(AFFINE_STEPS)} can't be folded into the model.")
+            remaining.append(st)
+            continue
+        alpha, beta = alpha * a, beta * a + b
+    return alpha, beta, remaining
+
+
+def fold_conv_weights(weight, bias, alpha, beta, fold_swap=False):
+    """Fold input affine into conv weight and bias
+
+    conv(x * a + b) = conv'(x) where W'[:, c] = W[:, c] * a[c] and B' = B + sum(W[:, c] * b[c])
+
+    Args:
+        weight (np.ndarray): Conv weight [out, 3, kh, kw] taking RGB input.
+        bias (np.ndarray): Conv bias [out].
+        alpha (np.ndarray): BGR ordered scale.
+        beta (np.ndarray): BGR ordered shift.
+        fold_swap (bool, optional): Make the conv take BGR input. Defaults to False.
+
+    Returns:
+        Tuple[np.ndarray, np.ndarray]: folded weight and bias.
+    """
+    a, b = alpha[::-1], beta[::-1]  # blob channels are RGB
+    new_bias = bias + (weight * b[None, :, None, None]).sum(axis=(1, 2, 3))
+    new_weight = weight * a[None, :, None, None]
+    if fold_swap:  # input channel 0 becomes B
+        new_weight = new_weight[:, ::-1]
+    return new_weight.astype(np.float32), new_bias.astype(np.float32)
+
+
+def fold_model(model, alpha, beta, fold_swap=False, uint8_input=False):
+    """Rewrite the first convolution of the model to absorb the input affine"""
+    graph = model.graph
+    initializers = {init.name: init for init in graph.initializer}
+    input_name = graph.input[0].name
+
+    consumers = [node for node in graph.node if input_name in node.input]
+    if len(consumers) != 1 or consumers[0].op_type != "Conv":
+        raise ValueError("Model input must be consumed by a single Conv node to fold preprocessing.")
+    conv = consumers[0]
+
+    attrs = {attr.name: helper.get_attribute_value(attr) for attr in conv.attribute}
+    if attrs.get("group", 1) != 1 or conv.input[1] not in initializers:
+        raise ValueError("First Conv must be a non grouped convolution with constant weight.")
+    if np.any(beta != 0) and any(attrs.get("pads", [])):
+        log_warning(
+            "Fold",
+            "First Conv is zero padded and mean isn't zero, outputs on the image border will differ slightly.",
+        )
+
+    weight = numpy_helper.to_array(initializers[conv.input[1]]).astype(np.float64)
+    has_bias = len(conv.input) > 2 and conv.input[2] != ""
+    bias = (
+        numpy_helper.to_array(initializers[conv.input[2]]).astype(np.float64)
+        if has_bias
+        else np.zeros(weight.shape[0])
+    )
+    new_weight, new_bias = fold_conv_weights(weight, bias, alpha, beta, fold_swap)
+
+    # add folded params as new initializers, old ones are dropped if unused
+    weight_name, bias_name = f"{conv.name or 'conv'}_folded_weight", f"{conv.name or 'conv'}_folded_bias"
+    graph.initializer.extend(
+        [numpy_helper.from_array(new_weight, weight_name), numpy_helper.from_array(new_bias, bias_name)]
+    )
+    old_params = [conv.input[1]] + ([conv.input[2]] if has_bias else [])
+    if has_bias:
+        conv.input[2] = bias_name
+    else:
+        conv.input.append(bias_name)
+    conv.input[1] = weight_name
+    for name in old_params:
+        if not any(name in node.input for node in graph.node):
+            graph.initializer.remove(initializers[name])
+
+    if uint8_input:  # take raw uint8 pixels and cast inside the model
+        cast_output = f"{input_name}_float"
+        graph.node.insert(0, helper.make_node("Cast", [input_name], [cast_output], to=TensorProto.FLOAT))
+        conv.input[0] = cast_output
+        graph.input[0].type.tensor_type.elem_type = TensorProto.UINT8
+
+    return model
+
+
+def get_configs():
+    parser = argparse.ArgumentParser(
+        description="Fold Standardize / Normalize preprocessing into YOLO-NAS first convolution"
+    )
+    required = parser.add_argument_group("required arguments")
+    required.add_argument("-m", "--model", type=str, required=True, help="YOLO-NAS ONNX model path")
+    parser.add_argument("-o", "--output", type=str, help="Output model path [default: <model>-folded.onnx]")
+    parser.add_argument(
+        "--custom-metadata",
+        type=str,
+        help="Path to metadata file (Generated from https://gist.github.com/Hyuto/f3db1c0c2c36308284e101f441c2555f)",
+    )
+    parser.add_argument(
+        "--metadata-output", type=str, help="Output metadata path [default: <output without ext>.json]"
+    )
+    parser.add_argument(
+        "--fold-swap",
+        action="store_true",
+        help="Fold BGR to RGB swap too, the model will take BGR input",
+    )
+    parser.add_argument(
+        "--uint8-input",
+        action="store_true",
+        help="Make the model input uint8 (for onnxruntime, OpenCV DNN already accepts 8 bit blobs)",
+    )
+    opt = parser.parse_args()
+
+    if not os.path.exists(opt.model):
+        raise FileNotFoundError("Wrong path! Not found ONNX model.")
+    if opt.custom_metadata and not os.path.exists(opt.custom_metadata):
+        raise FileNotFoundError("Wrong path! Metadata file not found.")
+    if not opt.output:
+        opt.output = f"{os.path.splitext(opt.model)[0]}-folded.onnx"
+    if not opt.metadata_output:
+        opt.metadata_output = f"{os.path.splitext(opt.output)[0]}.json"
+    return opt
+
+
+if __name__ == "__main__":
+    opt = get_configs()
+    model = onnx.load(opt.model)
+
+    if opt.custom_metadata:
+        with open(opt.custom_metadata) as f:
+            metadata = json.load(f)
+    else:  # default YOLO-NAS COCO metadata
+        dims = model.graph.input[0].type.tensor_type.shape.dim
+        metadata = {
+            "original_insz": [d.dim_value for d in dims],
+            "iou_thres": 0.45,
+            "score_thres": 0.25,
+            "prep_steps": YOLO_NAS_DEFAULT_PROCESSING_STEPS,
+            "labels": COCO_DEFAULT_LABELS,
+        }
+
+    alpha, beta, remaining_steps = get_affine(metadata["prep_steps"])
+    model = fold_model(model, alpha, beta, opt.fold_swap, opt.uint8_input)
+    onnx.checker.check_model(model)
+    onnx.save(model, opt.output)
+    log_info("Export Model", opt.output)
+
+    metadata["prep_steps"] = remaining_steps
+    metadata["input_channel_order"] = "BGR" if opt.fold_swap else "RGB"
+    metadata["input_dtype"] = "uint8" if opt.uint8_input else "float32"
+    with open(opt.metadata_output, "w") as f:
+        json.dump(metadata, f, indent=2)
+    log_info("Export Metadata", opt.metadata_output)